@@ -0,0 +1,349 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: bench.cpp
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: microbenchmarks of the kernels and components, one json line per result.
+*/
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <functional>
+
+#include "args.h"
+#include "alphabet.h"
+#include "dictionary.h"
+#include "matrix.h"
+#include "model.h"
+#include "kernels.h"
+#include "random.h"
+
+#ifndef W2V_SAMPLE_DIR
+#define W2V_SAMPLE_DIR "../sample"
+#endif
+
+namespace bench {
+
+std::string filter = "";
+double minTime = 0.2;
+
+/**
+* @Function: keep a value alive for the optimizer.
+*/
+template <class T>
+inline void keep(T const& value) {
+	asm volatile("" : : "g"(&value) : "memory");
+}
+
+/**
+* @Function: run fn until minTime has passed, fn returns the ops it did.
+*/
+void run(const std::string& name, const std::string& params, std::function<int64_t()> fn) {
+	if (filter != "" && name.find(filter) == std::string::npos) {
+		return;
+	}
+	typedef std::chrono::steady_clock clock;
+	fn();
+	int64_t ops = 0;
+	int64_t iters = 0;
+	auto start = clock::now();
+	double elapsed = 0.0;
+	do {
+		ops += fn();
+		iters++;
+		elapsed = std::chrono::duration<double>(clock::now() - start).count();
+	} while (elapsed < minTime);
+	std::cout << "{\"bench\":\"" << name << "\"," << params
+		<< "\"iters\":" << iters << ",\"ops\":" << ops
+		<< ",\"ns_per_op\":" << elapsed * 1e9 / ops
+		<< ",\"ops_per_sec\":" << ops / elapsed << "}" << std::endl;
+}
+
+std::string param(const std::string& key, int64_t value) {
+	return "\"" + key + "\":" + std::to_string(value) + ",";
+}
+
+std::string param(const std::string& key, const std::string& value) {
+	return "\"" + key + "\":\"" + value + "\",";
+}
+
+/**
+* @Function: dotRow/addRow of the runtime-dim Matrix and the fixed-dim kernels.
+*/
+template <int32_t DIM>
+void matrix(int64_t dim) {
+	const int64_t rows = 1 << 16;
+	Matrix m(rows, dim);
+	m.uniform(0.1);
+	std::vector<real> vec(dim, 0.5);
+	rng::engine g(1);
+	std::vector<int32_t> ids(4096);
+	for (size_t i = 0; i < ids.size(); i++) {
+		ids[i] = rng::bounded(g, rows);
+	}
+	run("Matrix::dotRow", param("dim", dim), [&]() {
+		real d = 0.0;
+		for (size_t i = 0; i < ids.size(); i++) {
+			d += m.dotRow(vec, ids[i]);
+		}
+		keep(d);
+		return int64_t(ids.size());
+	});
+	run("Matrix::addRow", param("dim", dim), [&]() {
+		for (size_t i = 0; i < ids.size(); i++) {
+			m.addRow(vec, ids[i], 1e-6);
+		}
+		keep(m);
+		return int64_t(ids.size());
+	});
+	if (DIM > 0) {
+		run("kernels::dot", param("dim", dim), [&]() {
+			real d = 0.0;
+			for (size_t i = 0; i < ids.size(); i++) {
+				d += kernels::dot<DIM>(m.row(ids[i]), vec.data(), DIM);
+			}
+			keep(d);
+			return int64_t(ids.size());
+		});
+		run("kernels::axpy", param("dim", dim), [&]() {
+			for (size_t i = 0; i < ids.size(); i++) {
+				kernels::axpy<DIM>(m.row(ids[i]), 1e-6, vec.data(), DIM);
+			}
+			keep(m);
+			return int64_t(ids.size());
+		});
+	}
+}
+
+/**
+* @Function: negative sampling, update and the sigmoid/log tables of a Model.
+*/
+void model(int32_t dim) {
+	std::shared_ptr<Args> args = std::make_shared<Args>();
+	args->dim = dim;
+	const int64_t nwords = 100000;
+	std::shared_ptr<Matrix> wi = std::make_shared<Matrix>(nwords, dim);
+	std::shared_ptr<Matrix> wo = std::make_shared<Matrix>(nwords, dim);
+	wi->uniform(1.0 / dim);
+	wo->zero();
+	Model m(wi, wo, args, 1);
+	std::vector<int64_t> counts(nwords);
+	for (int64_t i = 0; i < nwords; i++) {
+		counts[i] = nwords / (i + 1) + 1;
+	}
+	m.setTargetCounts(counts);
+	rng::engine g(2);
+	std::vector<int32_t> input(1);
+	run("Model::negativeSampling", param("dim", dim) + param("neg", args->neg), [&]() {
+		for (int32_t i = 0; i < 1000; i++) {
+			keep(m.negativeSampling(rng::bounded(g, nwords), 0.025));
+		}
+		return int64_t(1000);
+	});
+	run("Model::update", param("dim", dim) + param("neg", args->neg), [&]() {
+		for (int32_t i = 0; i < 1000; i++) {
+			input[0] = rng::bounded(g, nwords);
+			m.update(input, rng::bounded(g, nwords), 0.025);
+		}
+		return int64_t(1000);
+	});
+	if (dim != 100) {
+		return;
+	}
+	std::vector<real> xs(4096);
+	for (size_t i = 0; i < xs.size(); i++) {
+		xs[i] = rng::uniform(g) * 20 - 10;
+	}
+	run("Model::sigmoid", "", [&]() {
+		real s = 0.0;
+		for (size_t i = 0; i < xs.size(); i++) {
+			s += m.sigmoid(xs[i]);
+		}
+		keep(s);
+		return int64_t(xs.size());
+	});
+	run("Model::log", "", [&]() {
+		real s = 0.0;
+		for (size_t i = 0; i < xs.size(); i++) {
+			s += m.log((xs[i] + 10) / 20);
+		}
+		keep(s);
+		return int64_t(xs.size());
+	});
+}
+
+/**
+* @Function: from_string hits and misses at several vocabulary sizes.
+*/
+void quark(int32_t size) {
+	alphabet a;
+	a.setCapacity(size + 1);
+	rng::engine g(3);
+	std::vector<std::string> hits;
+	std::vector<std::string> misses;
+	for (int32_t i = 0; i < size; i++) {
+		a.add_string("w" + std::to_string(i));
+	}
+	for (int32_t i = 0; i < 4096; i++) {
+		hits.push_back("w" + std::to_string(rng::bounded(g, size)));
+		misses.push_back("x" + std::to_string(rng::bounded(g, size)));
+	}
+	run("basic_quark::from_string", param("vocab", size) + param("lookup", "hit"), [&]() {
+		int64_t s = 0;
+		for (size_t i = 0; i < hits.size(); i++) {
+			s += a.from_string(hits[i]);
+		}
+		keep(s);
+		return int64_t(hits.size());
+	});
+	run("basic_quark::from_string", param("vocab", size) + param("lookup", "miss"), [&]() {
+		int64_t s = 0;
+		for (size_t i = 0; i < misses.size(); i++) {
+			s += a.from_string(misses[i]);
+		}
+		keep(s);
+		return int64_t(misses.size());
+	});
+}
+
+/**
+* @Function: readWord, getLine and the subword/subfeature ngrams on the sample corpora.
+*/
+void dictionary(const std::string& sample, model_name mn) {
+	std::shared_ptr<Args> args = std::make_shared<Args>();
+	args->model = mn;
+	args->minCount = 1;
+	args->verbose = 0;
+	args->input = sample + "/giga_char_sample.txt";
+	args->incomponent = sample + "/char_component_sample.txt";
+	std::ifstream ifs(args->input);
+	if (!ifs.is_open()) {
+		std::cerr << args->input << " cannot be opened, dictionary benchmarks skipped." << std::endl;
+		return;
+	}
+	std::stringstream corpus;
+	corpus << ifs.rdbuf();
+	ifs.close();
+	const std::string text = corpus.str();
+
+	Dictionary dict(args);
+	std::istringstream in(text);
+	if (mn == model_name::subcomponent) {
+		std::ifstream infeature(args->incomponent);
+		dict.readFromFile(in, infeature);
+	} else {
+		dict.readFromFile(in);
+	}
+	const std::string name = args->modelToString(mn);
+
+	run("Dictionary::readWord", param("model", name), [&]() {
+		std::istringstream in(text);
+		std::string word;
+		int64_t n = 0;
+		while (dict.readWord(in, word)) {
+			n++;
+		}
+		return n;
+	});
+	rng::engine g(4);
+	run("Dictionary::getLine", param("model", name), [&]() {
+		std::istringstream in(text);
+		std::vector<std::vector<int32_t> > sourceType;
+		std::vector<std::vector<int32_t> > source;
+		std::vector<int32_t> target;
+		int64_t n = 0;
+		while (!in.eof()) {
+			n += dict.getLine(in, sourceType, source, target, g);
+			in.peek();
+		}
+		return n;
+	});
+
+	std::vector<std::string> words;
+	for (int32_t i = 0; i < dict.nwords() && i < 4096; i++) {
+		words.push_back(Dictionary::BOW + dict.getWord(i) + Dictionary::EOW);
+	}
+	if (mn == model_name::subword) {
+		run("Dictionary::computeSubwords", param("model", name), [&]() {
+			std::vector<int32_t> ngrams;
+			for (size_t i = 0; i < words.size(); i++) {
+				ngrams.clear();
+				dict.computeSubwords(words[i], ngrams);
+			}
+			keep(ngrams);
+			return int64_t(words.size());
+		});
+	}
+	if (mn == model_name::subcomponent) {
+		std::vector<std::string> feats;
+		for (int32_t i = 0; i < dict.nwords() && i < 4096; i++) {
+			feats.push_back(Dictionary::BOW + dict.getFeat(dict.getWord(i)) + Dictionary::EOW);
+		}
+		run("Dictionary::computerSubfeat", param("model", name), [&]() {
+			std::vector<int32_t> ngrams;
+			for (size_t i = 0; i < feats.size(); i++) {
+				ngrams.clear();
+				dict.computerSubfeat(feats[i], ngrams);
+			}
+			keep(ngrams);
+			return int64_t(feats.size());
+		});
+	}
+}
+
+}
+
+void printUsage() {
+	std::cerr
+		<< "usage: word2vec_bench [-filter <name>] [-minTime <sec>] [-sample <dir>]\n\n"
+		<< "  -filter   only run benchmarks whose name contains this string\n"
+		<< "  -minTime  minimal seconds per benchmark default:[" << bench::minTime << "]\n"
+		<< "  -sample   directory of the sample corpora default:[" << W2V_SAMPLE_DIR << "]\n"
+		<< std::endl;
+}
+
+int main(int argc, char** argv) {
+	std::vector<std::string> args(argv, argv + argc);
+	std::string sample = W2V_SAMPLE_DIR;
+	for (size_t ai = 1; ai < args.size(); ai += 2) {
+		if (ai + 1 >= args.size()) {
+			printUsage();
+			exit(EXIT_FAILURE);
+		}
+		if (args[ai] == "-filter") {
+			bench::filter = args[ai + 1];
+		} else if (args[ai] == "-minTime") {
+			bench::minTime = std::stod(args[ai + 1]);
+		} else if (args[ai] == "-sample") {
+			sample = args[ai + 1];
+		} else {
+			printUsage();
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	bench::matrix<50>(50);
+	bench::matrix<100>(100);
+	bench::matrix<128>(128);
+	bench::matrix<200>(200);
+	bench::matrix<256>(256);
+	bench::matrix<300>(300);
+	bench::matrix<0>(77);
+
+	bench::model(100);
+	bench::model(300);
+	bench::model(77);
+
+	bench::quark(1000);
+	bench::quark(100000);
+	bench::quark(1000000);
+
+	bench::dictionary(sample, model_name::subword);
+	bench::dictionary(sample, model_name::subcomponent);
+	return 0;
+}
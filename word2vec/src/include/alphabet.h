@@ -23,6 +23,8 @@
 #include <assert.h>
 #include <iostream>
 
+#include "memreport.h"
+
 using namespace std;
 
 class basic_quark {
@@ -139,6 +141,14 @@ class basic_quark {
         return m_size;
     }
 
+    /**
+     * Bytes held by the maps, the strings and the counts.
+     */
+    int64_t memoryUsage() const {
+        return memreport::bytes(m_string_to_id) + memreport::bytes(m_id_to_string)
+            + memreport::bytes(m_id_to_freq);
+    }
+
     void prune(int threshold) {
         if (m_reduce_threshold >= threshold) {
             return;
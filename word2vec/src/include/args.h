@@ -20,10 +20,12 @@ class Args {
 	protected:
 		std::string lossToString(loss_name) const;
 		std::string boolToString(bool) const;
-		std::string modelToString(model_name) const;
+		static void saveString(std::ostream&, const std::string&);
+		static std::string loadString(std::istream&);
 
 	public:
 		Args();
+		std::string modelToString(model_name) const;
 		std::string input;
 		std::string inradical;
 		std::string incomponent;
@@ -51,6 +53,42 @@ class Args {
 		std::string componentpad;
 		std::string featurepad;
 		bool saveOutput;
+		int seed;
+		bool deterministic;
+		bool sparseGrad;
+		std::string telemetry;
+		std::string prometheus;
+		double telemetryInterval;
+		bool profile;
+		int profileSample;
+		std::string profileTrace;
+		bool perf;
+		uint64_t perfRaw;
+		bool memreport;
+		bool saveBinary;
+		int exportPrecision;
+		int exportShards;
+		std::string checkpoint;
+		double checkpointInterval;
+		int checkpointDeltas;
+		std::string previous;
+		std::string vectors;
+		std::string section;
+		int k;
+		std::string index;
+		int M;
+		int efConstruction;
+		int efSearch;
+		std::string quantizer;
+		int dsub;
+		int cacheSize;
+		std::string socket;
+		std::string live;
+		std::string analogy;
+		std::string similarity;
+		int64_t evalEvery;
+		int patience;
+		double minDelta;
 
 		size_t cutoff;
 		void parseArgs(const std::vector<std::string>& args);
@@ -91,6 +129,43 @@ Args::Args() {
 	componentpad = 'N';
 	featurepad = 'N';
 	saveOutput = false;
+	seed = 0;
+	deterministic = false;
+	sparseGrad = false;
+	telemetry = "";
+	prometheus = "";
+	telemetryInterval = 10;
+	profile = false;
+	profileSample = 64;
+	profileTrace = "";
+	perf = false;
+	perfRaw = 0;
+	memreport = false;
+	saveBinary = false;
+	exportPrecision = 5;
+	exportShards = 1;
+	checkpoint = "";
+	checkpointInterval = 600;
+	checkpointDeltas = 10;
+	previous = "";
+	vectors = "";
+	section = "words";
+	k = 10;
+	index = "";
+	M = 16;
+	efConstruction = 200;
+	efSearch = 50;
+	quantizer = "pq";
+	dsub = 2;
+	cacheSize = 100000;
+	socket = "word2vec.sock";
+	live = "";
+	analogy = "";
+	similarity = "";
+	evalEvery = 0;
+	patience = 0;
+	minDelta = 0.001;
+	cutoff = 0;
 }
 
 /**
@@ -179,6 +254,86 @@ void Args::parseArgs(const std::vector<std::string>& args) {
 			} else if (args[ai] == "-saveOutput") {
 				saveOutput = true;
 				ai--;
+			} else if (args[ai] == "-seed") {
+				seed = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-deterministic") {
+				deterministic = true;
+				ai--;
+			} else if (args[ai] == "-sparseGrad") {
+				sparseGrad = true;
+				ai--;
+			} else if (args[ai] == "-telemetry") {
+				telemetry = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-prometheus") {
+				prometheus = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-telemetryInterval") {
+				telemetryInterval = std::stof(args.at(ai + 1));
+			} else if (args[ai] == "-profile") {
+				profile = true;
+				ai--;
+			} else if (args[ai] == "-profileSample") {
+				profileSample = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-profileTrace") {
+				profile = true;
+				profileTrace = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-perf") {
+				perf = true;
+				ai--;
+			} else if (args[ai] == "-perfRaw") {
+				perf = true;
+				perfRaw = std::stoull(args.at(ai + 1), nullptr, 0);
+			} else if (args[ai] == "-memreport") {
+				memreport = true;
+				ai--;
+			} else if (args[ai] == "-saveBinary") {
+				saveBinary = true;
+				ai--;
+			} else if (args[ai] == "-exportPrecision") {
+				exportPrecision = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-exportShards") {
+				exportShards = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-checkpoint") {
+				checkpoint = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-checkpointInterval") {
+				checkpointInterval = std::stof(args.at(ai + 1));
+			} else if (args[ai] == "-checkpointDeltas") {
+				checkpointDeltas = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-previous") {
+				previous = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-vectors") {
+				vectors = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-section") {
+				section = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-k") {
+				k = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-index") {
+				index = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-M") {
+				M = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-efConstruction") {
+				efConstruction = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-efSearch") {
+				efSearch = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-quantizer") {
+				quantizer = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-dsub") {
+				dsub = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-cacheSize") {
+				cacheSize = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-socket") {
+				socket = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-live") {
+				live = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-analogy") {
+				analogy = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-similarity") {
+				similarity = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-evalEvery") {
+				evalEvery = std::stoll(args.at(ai + 1));
+			} else if (args[ai] == "-patience") {
+				patience = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-minDelta") {
+				minDelta = std::stod(args.at(ai + 1));
 			} else if (args[ai] == "-cutoff") {
 				cutoff = std::stoi(args.at(ai + 1));
 			} else {
@@ -263,8 +418,45 @@ void Args::printTrainingHelp() {
 		<< "  -neg                number of negatives sampled default:[" << neg << "]\n"
 		<< "  -loss               loss function {ns} default:[" << lossToString(loss) << "]\n"
 		<< "  -thread             number of threads default:[" << thread << "]\n"
-		<< "  -pretrainedVectors  pretrained word vectors for supervised learning default:[" << pretrainedVectors << "]\n"
-		<< "  -saveOutput         whether output params should be saved default:[" << boolToString(saveOutput) << "]\n";
+		<< "  -pretrainedVectors  comma-separated .bin models or text vectors (a .feature file holds features, other text files words) to warm-start the input rows default:[" << pretrainedVectors << "]\n"
+		<< "  -saveOutput         whether output params should be saved default:[" << boolToString(saveOutput) << "]\n"
+		<< "  -seed               seed of the random engines default:[" << seed << "]\n"
+		<< "  -deterministic      same seed and thread count give the same vectors default:[" << boolToString(deterministic) << "]\n"
+		<< "  -sparseGrad         sum input gradients by row and write them once per line default:[" << boolToString(sparseGrad) << "]\n"
+		<< "  -telemetry          json-lines file of the training telemetry default:[" << telemetry << "]\n"
+		<< "  -prometheus         prometheus text file of the training telemetry default:[" << prometheus << "]\n"
+		<< "  -telemetryInterval  seconds between two telemetry records default:[" << telemetryInterval << "]\n"
+		<< "  -profile            report the time of each training phase default:[" << boolToString(profile) << "]\n"
+		<< "  -profileSample      profile one line out of this many default:[" << profileSample << "]\n"
+		<< "  -profileTrace       chrome trace-event file of the profiled lines default:[" << profileTrace << "]\n"
+		<< "  -perf               report hardware counters per million tokens default:[" << boolToString(perf) << "]\n"
+		<< "  -perfRaw            raw perf event code counted as cache-line transfers default:[" << perfRaw << "]\n"
+		<< "  -memreport          print and save the memory used by each data structure default:[" << boolToString(memreport) << "]\n"
+		<< "  -saveBinary         also save the mmap-able binary model to <output>.bin default:[" << boolToString(saveBinary) << "]\n"
+		<< "  -exportPrecision    significant digits of the text vectors, 0 for the shortest text that reads back exactly (about 3x slower to export) default:[" << exportPrecision << "]\n"
+		<< "  -exportShards       split each text file into this many files <file>.0, <file>.1, ... default:[" << exportShards << "]\n"
+		<< "  -checkpoint         checkpoint file written during training, resumed by the resume command default:[" << checkpoint << "]\n"
+		<< "  -checkpointInterval seconds between two checkpoints default:[" << checkpointInterval << "]\n"
+		<< "  -checkpointDeltas   checkpoints of the changed rows only between two full ones, 0 for always full default:[" << checkpointDeltas << "]\n"
+		<< "  -previous           checkpoint of the model continued by the update command default:[" << previous << "]\n"
+		<< "  -vectors            text vectors or binary model queried by the nn command default:[" << vectors << "]\n"
+		<< "  -section            words, features or targets of a binary model default:[" << section << "]\n"
+		<< "  -k                  number of neighbours returned default:[" << k << "]\n"
+		<< "  -index              hnsw index written by the hnsw command (<vectors>.hnsw if empty) and searched by nn default:[" << index << "]\n"
+		<< "  -M                  links per node of the hnsw index default:[" << M << "]\n"
+		<< "  -efConstruction     beam width while building the hnsw index default:[" << efConstruction << "]\n"
+		<< "  -efSearch           beam width of the hnsw queries default:[" << efSearch << "]\n"
+		<< "  -quantizer          pq for product quantization or int8 for per-row int8 scaling default:[" << quantizer << "]\n"
+		<< "  -dsub               size of each pq sub-vector default:[" << dsub << "]\n"
+		<< "  -cutoff             rows kept per section by the quantize command, the most frequent, 0 for all default:[" << cutoff << "]\n"
+		<< "  -cacheSize          vectors of unseen words kept in the cache, 0 to disable default:[" << cacheSize << "]\n"
+		<< "  -socket             unix socket path of the serve command default:[" << socket << "]\n"
+		<< "  -live               train the matrices in this shared memory object, read by -vectors shm:<name> default:[" << live << "]\n"
+		<< "  -analogy            analogy questions \"a b c d\" with \": section\" lines, evaluated by eval default:[" << analogy << "]\n"
+		<< "  -similarity         word pairs \"w1 w2 score\" scored by spearman correlation in eval default:[" << similarity << "]\n"
+		<< "  -evalEvery          tokens between two evaluations of -analogy / -similarity while training, 0 to disable default:[" << evalEvery << "]\n"
+		<< "  -patience           stop training after this many evaluations without improvement, 0 to disable default:[" << patience << "]\n"
+		<< "  -minDelta           smallest increase of the score (accuracy, spearman, or -loss without sets) that counts default:[" << minDelta << "]\n";
 }
 
 /**
@@ -310,4 +502,90 @@ std::string Args::modelToString(model_name mn) const {
 	default:
 		return "Unknow model name!";
 	}
-}
\ No newline at end of file
+}
+
+/**
+* @Function: write a string as its length and bytes.
+*/
+void Args::saveString(std::ostream& out, const std::string& s) {
+	int32_t n = s.size();
+	out.write((char*)&n, sizeof(int32_t));
+	out.write(s.data(), n);
+}
+
+/**
+* @Function: read a string written by saveString.
+*/
+std::string Args::loadString(std::istream& in) {
+	int32_t n = 0;
+	in.read((char*)&n, sizeof(int32_t));
+	std::string s(n, '\0');
+	in.read(&s[0], n);
+	return s;
+}
+
+/**
+* @Function: save the arguments that define the model and the training, not the reporting ones.
+*/
+void Args::save(std::ostream& out) {
+	saveString(out, input);
+	saveString(out, inradical);
+	saveString(out, incomponent);
+	saveString(out, output);
+	out.write((char*)&lr, sizeof(double));
+	out.write((char*)&lrUpdateRate, sizeof(int));
+	out.write((char*)&dim, sizeof(int));
+	out.write((char*)&ws, sizeof(int));
+	out.write((char*)&epoch, sizeof(int));
+	out.write((char*)&minCount, sizeof(int));
+	out.write((char*)&minCountLabel, sizeof(int));
+	out.write((char*)&neg, sizeof(int));
+	out.write((char*)&loss, sizeof(loss_name));
+	out.write((char*)&model, sizeof(model_name));
+	out.write((char*)&bucket, sizeof(int));
+	out.write((char*)&minn, sizeof(int));
+	out.write((char*)&maxn, sizeof(int));
+	out.write((char*)&thread, sizeof(int));
+	out.write((char*)&t, sizeof(double));
+	saveString(out, label);
+	saveString(out, radical);
+	saveString(out, radicalpad);
+	saveString(out, componentpad);
+	saveString(out, featurepad);
+	out.write((char*)&seed, sizeof(int));
+	out.write((char*)&deterministic, sizeof(bool));
+	out.write((char*)&sparseGrad, sizeof(bool));
+}
+
+/**
+* @Function: load the arguments written by save.
+*/
+void Args::load(std::istream& in) {
+	input = loadString(in);
+	inradical = loadString(in);
+	incomponent = loadString(in);
+	output = loadString(in);
+	in.read((char*)&lr, sizeof(double));
+	in.read((char*)&lrUpdateRate, sizeof(int));
+	in.read((char*)&dim, sizeof(int));
+	in.read((char*)&ws, sizeof(int));
+	in.read((char*)&epoch, sizeof(int));
+	in.read((char*)&minCount, sizeof(int));
+	in.read((char*)&minCountLabel, sizeof(int));
+	in.read((char*)&neg, sizeof(int));
+	in.read((char*)&loss, sizeof(loss_name));
+	in.read((char*)&model, sizeof(model_name));
+	in.read((char*)&bucket, sizeof(int));
+	in.read((char*)&minn, sizeof(int));
+	in.read((char*)&maxn, sizeof(int));
+	in.read((char*)&thread, sizeof(int));
+	in.read((char*)&t, sizeof(double));
+	label = loadString(in);
+	radical = loadString(in);
+	radicalpad = loadString(in);
+	componentpad = loadString(in);
+	featurepad = loadString(in);
+	in.read((char*)&seed, sizeof(int));
+	in.read((char*)&deterministic, sizeof(bool));
+	in.read((char*)&sparseGrad, sizeof(bool));
+}
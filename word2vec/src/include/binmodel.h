@@ -0,0 +1,504 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: binmodel.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: versioned binary model format, written once and loaded with a single mmap.
+*/
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "args.h"
+#include "dictionary.h"
+#include "matrix.h"
+#include "real.h"
+
+/*
+* File layout, all offsets in bytes from the start of the file:
+*   Header                      128 bytes
+*   Entry[nwords + nfeatures + ntargets]   string offset, length and count
+*   int32_t[nwords + nfeatures + ntargets] ids of each section sorted by string
+*   string pool                 bytes of all the strings, not terminated
+*   input block                 (nwords + nfeatures) x dim, 64-byte aligned
+*   output block                ntargets x dim, 64-byte aligned
+*/
+namespace binmodel {
+
+static const uint32_t MAGIC = 0x56573242; // "B2WV" on little-endian
+static const uint32_t VERSION = 1;
+static const uint64_t ALIGN = 64;
+
+enum dtype : uint32_t { FLOAT32 = 1, FLOAT64 = 2 };
+
+enum section : int32_t { WORDS = 0, FEATURES, TARGETS, NSECTIONS };
+
+struct Header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t dtype;
+	uint32_t dim;
+	int32_t model;
+	int32_t minn;
+	int32_t maxn;
+	int32_t reserved;
+	int64_t nwords;
+	int64_t nfeatures;
+	int64_t ntargets;
+	int64_t ntokens;
+	// training progress when written, 1 for a finished model
+	double progress;
+	uint64_t entries;
+	uint64_t index;
+	uint64_t strings;
+	uint64_t input;
+	uint64_t output;
+	uint64_t size;
+	uint64_t pad;
+};
+static_assert(sizeof(Header) == 128, "binmodel::Header must stay 128 bytes");
+
+struct Entry {
+	uint64_t offset;
+	uint32_t length;
+	uint32_t reserved;
+	int64_t count;
+};
+static_assert(sizeof(Entry) == 24, "binmodel::Entry must stay 24 bytes");
+
+inline uint64_t align(uint64_t offset) {
+	return (offset + ALIGN - 1) / ALIGN * ALIGN;
+}
+
+inline uint32_t currentDtype() {
+	return sizeof(real) == 4 ? FLOAT32 : FLOAT64;
+}
+
+/**
+* @Function: write zero bytes up to the next aligned offset.
+*/
+inline void pad(std::ostream& out, uint64_t& offset) {
+	static const char zeros[ALIGN] = { 0 };
+	uint64_t next = align(offset);
+	out.write(zeros, next - offset);
+	offset = next;
+}
+
+/**
+* @Function: strings and counts of the three sections in id order.
+*/
+struct Vocab {
+	std::vector<std::string> strings[NSECTIONS];
+	std::vector<int64_t> counts[NSECTIONS];
+};
+
+/**
+* @Function: the header of a model, offsets filled in for the given vocabulary.
+*/
+Header layout(const Args& args, const Dictionary& dict, const Vocab& vocab) {
+	Header h;
+	std::memset(&h, 0, sizeof(h));
+	h.magic = MAGIC;
+	h.version = VERSION;
+	h.dtype = currentDtype();
+	h.dim = args.dim;
+	h.model = int32_t(args.model);
+	h.minn = args.minn;
+	h.maxn = args.maxn;
+	h.nwords = vocab.strings[WORDS].size();
+	h.nfeatures = vocab.strings[FEATURES].size();
+	h.ntargets = vocab.strings[TARGETS].size();
+	h.ntokens = dict.ntokens();
+	int64_t n = h.nwords + h.nfeatures + h.ntargets;
+	uint64_t pool = 0;
+	for (int32_t s = 0; s < NSECTIONS; s++) {
+		for (size_t i = 0; i < vocab.strings[s].size(); i++) {
+			pool += vocab.strings[s][i].size();
+		}
+	}
+	h.entries = sizeof(Header);
+	h.index = h.entries + n * sizeof(Entry);
+	h.strings = h.index + n * sizeof(int32_t);
+	h.input = align(h.strings + pool);
+	h.output = align(h.input + (h.nwords + h.nfeatures) * h.dim * sizeof(real));
+	h.size = h.output + h.ntargets * h.dim * sizeof(real);
+	return h;
+}
+
+/**
+* @Function: strings and counts of the dictionary.
+*/
+Vocab vocabulary(const Dictionary& dict) {
+	Vocab vocab;
+	for (int32_t i = 0; i < dict.nwords(); i++) {
+		vocab.strings[WORDS].push_back(dict.getWord(i));
+	}
+	for (int32_t i = 0; i < dict.nfeatures(); i++) {
+		vocab.strings[FEATURES].push_back(dict.getFeature(i));
+	}
+	for (int32_t i = 0; i < dict.ntargets(); i++) {
+		vocab.strings[TARGETS].push_back(dict.getTarget(i));
+	}
+	vocab.counts[WORDS] = dict.getCounts();
+	vocab.counts[FEATURES] = dict.getFeatureCounts();
+	vocab.counts[TARGETS] = dict.getTargetCounts();
+	return vocab;
+}
+
+/**
+* @Function: the bytes between the header and the input block, entries, sorted index and string pool.
+*/
+std::string tables(const Vocab& vocab) {
+	std::string out;
+	uint64_t offset = 0;
+	for (int32_t s = 0; s < NSECTIONS; s++) {
+		for (size_t i = 0; i < vocab.strings[s].size(); i++) {
+			Entry e;
+			e.offset = offset;
+			e.length = vocab.strings[s][i].size();
+			e.reserved = 0;
+			e.count = i < vocab.counts[s].size() ? vocab.counts[s][i] : 0;
+			out.append((const char*)&e, sizeof(e));
+			offset += e.length;
+		}
+	}
+	for (int32_t s = 0; s < NSECTIONS; s++) {
+		const std::vector<std::string>& strings = vocab.strings[s];
+		std::vector<int32_t> index(strings.size());
+		for (size_t i = 0; i < index.size(); i++) {
+			index[i] = i;
+		}
+		std::sort(index.begin(), index.end(), [&](int32_t a, int32_t b) {
+			return strings[a] < strings[b];
+		});
+		out.append((const char*)index.data(), index.size() * sizeof(int32_t));
+	}
+	for (int32_t s = 0; s < NSECTIONS; s++) {
+		for (size_t i = 0; i < vocab.strings[s].size(); i++) {
+			out.append(vocab.strings[s][i]);
+		}
+	}
+	return out;
+}
+
+/**
+* @Function: save the dictionary and both matrices, atomically replacing path.
+*/
+void save(const std::string& path, const Args& args, const Dictionary& dict,
+		const Matrix& input, const Matrix& output, double progress) {
+	Vocab vocab = vocabulary(dict);
+	Header h = layout(args, dict, vocab);
+	h.progress = progress;
+	if (input.rows() != h.nwords + h.nfeatures || output.rows() < h.ntargets
+			|| input.cols() != h.dim || output.cols() != h.dim) {
+		throw std::invalid_argument("matrix shapes do not match the dictionary for " + path);
+	}
+
+	const std::string tmp = path + ".tmp";
+	std::ofstream ofs(tmp, std::ios::binary);
+	if (!ofs.is_open()) {
+		throw std::invalid_argument(tmp + " cannot be opened for saving the binary model.");
+	}
+	ofs.write((const char*)&h, sizeof(h));
+	const std::string bytes = tables(vocab);
+	ofs.write(bytes.data(), bytes.size());
+	uint64_t offset = h.entries + bytes.size();
+	pad(ofs, offset);
+	ofs.write((const char*)input.data(), input.rows() * input.cols() * sizeof(real));
+	offset += input.rows() * input.cols() * sizeof(real);
+	pad(ofs, offset);
+	ofs.write((const char*)output.data(), h.ntargets * h.dim * sizeof(real));
+	ofs.close();
+	if (!ofs) {
+		throw std::invalid_argument(tmp + " could not be written.");
+	}
+	if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+		throw std::invalid_argument(tmp + " cannot be renamed to " + path);
+	}
+}
+
+/**
+* @Function: name of a POSIX shared memory object, a single leading slash.
+*/
+inline std::string shmName(const std::string& name) {
+	return name.size() > 0 && name[0] == '/' ? name : "/" + name;
+}
+
+/**
+* @Function: a model laid out as a binary model in a named shared memory object, the matrices are
+* trained in place and other processes attach read-only with BinaryModel::open("shm:<name>").
+*/
+class Segment {
+  protected:
+	std::string name_;
+	char* base_;
+	size_t size_;
+
+  public:
+	Header* header;
+	real* input;
+	real* output;
+
+	Segment(const std::string&, const Args&, const Dictionary&, int64_t);
+	~Segment();
+	Segment(const Segment&) = delete;
+	Segment& operator=(const Segment&) = delete;
+};
+
+/**
+* @Function: create or replace the object of name, write the header and vocabulary of dict and leave room
+* for the input rows and outputRows output rows, readers follow the training through header->progress.
+*/
+Segment::Segment(const std::string& name, const Args& args, const Dictionary& dict, int64_t outputRows)
+	: name_(shmName(name)), base_(nullptr), size_(0), header(nullptr), input(nullptr), output(nullptr) {
+	Vocab vocab = vocabulary(dict);
+	Header h = layout(args, dict, vocab);
+	// the output block holds all the rows trained, the targets are the first ones
+	h.size = h.output + std::max<int64_t>(outputRows, h.ntargets) * h.dim * sizeof(real);
+	h.progress = 0;
+	int fd = shm_open(name_.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+	if (fd < 0) {
+		throw std::invalid_argument(name_ + " shared memory cannot be created.");
+	}
+	// reserve the pages now, a full /dev/shm then fails here and not with SIGBUS in the middle of training
+	if (ftruncate(fd, h.size) != 0 || posix_fallocate(fd, 0, h.size) != 0) {
+		::close(fd);
+		shm_unlink(name_.c_str());
+		throw std::invalid_argument(name_ + " shared memory cannot hold " + std::to_string(h.size) + " bytes.");
+	}
+	void* p = mmap(nullptr, h.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED) {
+		shm_unlink(name_.c_str());
+		throw std::invalid_argument(name_ + " shared memory cannot be mapped.");
+	}
+	base_ = (char*)p;
+	size_ = h.size;
+	const std::string bytes = tables(vocab);
+	std::memcpy(base_ + h.entries, bytes.data(), bytes.size());
+	input = (real*)(base_ + h.input);
+	output = (real*)(base_ + h.output);
+	// the magic last, a reader attaching before sees no model
+	h.magic = 0;
+	std::memcpy(base_, &h, sizeof(h));
+	header = (Header*)base_;
+	__atomic_store_n(&header->magic, MAGIC, __ATOMIC_RELEASE);
+}
+
+/**
+* @Function: unmap and remove the name, readers still attached keep their mapping.
+*/
+Segment::~Segment() {
+	if (base_ != nullptr) {
+		munmap(base_, size_);
+		shm_unlink(name_.c_str());
+	}
+}
+
+}
+
+/**
+* @Function: read-only view of a binary model mapped into memory.
+*/
+class BinaryModel {
+  protected:
+	const char* base_;
+	size_t size_;
+	const binmodel::Header* header_;
+	const binmodel::Entry* entries_;
+	const int32_t* index_;
+	const char* strings_;
+
+	int64_t first(int32_t) const;
+
+  public:
+	BinaryModel();
+	explicit BinaryModel(const std::string&);
+	~BinaryModel();
+	BinaryModel(const BinaryModel&) = delete;
+	BinaryModel& operator=(const BinaryModel&) = delete;
+
+	void open(const std::string&);
+	void close();
+
+	inline bool isOpen() const {
+		return base_ != nullptr;
+	}
+	inline const binmodel::Header& header() const {
+		return *header_;
+	}
+	inline int32_t dim() const {
+		return header_->dim;
+	}
+	int64_t size(int32_t) const;
+	std::string string(int32_t, int64_t) const;
+	int64_t count(int32_t, int64_t) const;
+	int64_t find(int32_t, const std::string&) const;
+	const real* vector(int32_t, int64_t) const;
+};
+
+BinaryModel::BinaryModel() : base_(nullptr), size_(0), header_(nullptr),
+	entries_(nullptr), index_(nullptr), strings_(nullptr) {}
+
+BinaryModel::BinaryModel(const std::string& path) : BinaryModel() {
+	open(path);
+}
+
+BinaryModel::~BinaryModel() {
+	close();
+}
+
+/**
+* @Function: map the file, or the shared memory object of a shm:<name> path, and check its header.
+*/
+void BinaryModel::open(const std::string& path) {
+	close();
+	// shm:<name> attaches to the shared memory of a training run with -live
+	const bool shm = path.compare(0, 4, "shm:") == 0;
+	int fd = shm ? shm_open(binmodel::shmName(path.substr(4)).c_str(), O_RDONLY, 0) : ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::invalid_argument(path + " cannot be opened for loading the binary model.");
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(binmodel::Header)) {
+		::close(fd);
+		throw std::invalid_argument(path + " is not a binary model.");
+	}
+	void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED) {
+		throw std::invalid_argument(path + " cannot be mapped.");
+	}
+	base_ = (const char*)p;
+	size_ = st.st_size;
+	header_ = (const binmodel::Header*)base_;
+	if (header_->magic != binmodel::MAGIC) {
+		close();
+		throw std::invalid_argument(path + " is not a binary model.");
+	}
+	if (header_->version != binmodel::VERSION || header_->dtype != binmodel::currentDtype()) {
+		close();
+		throw std::invalid_argument(path + " has an unsupported version or dtype.");
+	}
+	if (header_->size > size_) {
+		close();
+		throw std::invalid_argument(path + " is truncated.");
+	}
+	entries_ = (const binmodel::Entry*)(base_ + header_->entries);
+	index_ = (const int32_t*)(base_ + header_->index);
+	strings_ = base_ + header_->strings;
+}
+
+/**
+* @Function: unmap the file.
+*/
+void BinaryModel::close() {
+	if (base_ != nullptr) {
+		munmap((void*)base_, size_);
+	}
+	base_ = nullptr;
+	size_ = 0;
+	header_ = nullptr;
+}
+
+/**
+* @Function: position of the first entry of a section.
+*/
+int64_t BinaryModel::first(int32_t s) const {
+	switch (s) {
+	case binmodel::WORDS:
+		return 0;
+	case binmodel::FEATURES:
+		return header_->nwords;
+	default:
+		return header_->nwords + header_->nfeatures;
+	}
+}
+
+/**
+* @Function: number of entries of a section.
+*/
+int64_t BinaryModel::size(int32_t s) const {
+	switch (s) {
+	case binmodel::WORDS:
+		return header_->nwords;
+	case binmodel::FEATURES:
+		return header_->nfeatures;
+	default:
+		return header_->ntargets;
+	}
+}
+
+/**
+* @Function: string of an id.
+*/
+std::string BinaryModel::string(int32_t s, int64_t id) const {
+	assert(id >= 0 && id < size(s));
+	const binmodel::Entry& e = entries_[first(s) + id];
+	return std::string(strings_ + e.offset, e.length);
+}
+
+/**
+* @Function: count of an id.
+*/
+int64_t BinaryModel::count(int32_t s, int64_t id) const {
+	assert(id >= 0 && id < size(s));
+	return entries_[first(s) + id].count;
+}
+
+/**
+* @Function: id of a string, binary search in the sorted index, -1 if absent.
+*/
+int64_t BinaryModel::find(int32_t s, const std::string& str) const {
+	const int64_t base = first(s);
+	const int32_t* index = index_ + base;
+	int64_t lo = 0;
+	int64_t hi = size(s);
+	while (lo < hi) {
+		int64_t mid = lo + (hi - lo) / 2;
+		const binmodel::Entry& e = entries_[base + index[mid]];
+		size_t n = std::min<size_t>(e.length, str.size());
+		int c = std::memcmp(strings_ + e.offset, str.data(), n);
+		if (c == 0) {
+			c = e.length < str.size() ? -1 : (e.length > str.size() ? 1 : 0);
+		}
+		if (c == 0) {
+			return index[mid];
+		} else if (c < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return -1;
+}
+
+/**
+* @Function: vector of an id, words and features are rows of the input block, targets of the output block.
+*/
+const real* BinaryModel::vector(int32_t s, int64_t id) const {
+	assert(id >= 0 && id < size(s));
+	const real* input = (const real*)(base_ + header_->input);
+	switch (s) {
+	case binmodel::WORDS:
+		return input + id * header_->dim;
+	case binmodel::FEATURES:
+		return input + (header_->nwords + id) * header_->dim;
+	default:
+		return (const real*)(base_ + header_->output) + id * header_->dim;
+	}
+}
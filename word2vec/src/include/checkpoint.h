@@ -0,0 +1,340 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: checkpoint.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: checkpoints of a running training written by a background thread.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+#include "args.h"
+#include "dictionary.h"
+#include "matrix.h"
+#include "real.h"
+
+namespace checkpoint {
+
+static const char MAGIC[8] = { 'W', '2', 'V', 'C', 'K', 'P', 'T', '1' };
+static const char DELTA_MAGIC[8] = { 'W', '2', 'V', 'D', 'E', 'L', 'T', '1' };
+
+// rows copied at once from the live matrix, the training threads keep writing meanwhile
+static const int64_t CHUNK_BYTES = 4 << 20;
+
+/**
+* @Function: where the training threads were, restored by resume.
+*/
+struct Progress {
+	int64_t tokenCount;
+	// per thread, byte offset in the input file after the last trained line
+	std::vector<int64_t> positions;
+	// per thread, tokens trained, the share of a thread in deterministic mode
+	std::vector<int64_t> threadTokens;
+
+	Progress() : tokenCount(0) {}
+};
+
+/**
+* @Function: save the progress.
+*/
+void saveProgress(std::ostream& out, const Progress& p) {
+	int32_t n = p.positions.size();
+	out.write((char*)&p.tokenCount, sizeof(int64_t));
+	out.write((char*)&n, sizeof(int32_t));
+	out.write((char*)p.positions.data(), n * sizeof(int64_t));
+	out.write((char*)p.threadTokens.data(), n * sizeof(int64_t));
+}
+
+/**
+* @Function: load the progress written by saveProgress.
+*/
+void loadProgress(std::istream& in, Progress& p) {
+	int32_t n = 0;
+	in.read((char*)&p.tokenCount, sizeof(int64_t));
+	in.read((char*)&n, sizeof(int32_t));
+	p.positions.resize(n);
+	p.threadTokens.resize(n);
+	in.read((char*)p.positions.data(), n * sizeof(int64_t));
+	in.read((char*)p.threadTokens.data(), n * sizeof(int64_t));
+}
+
+/**
+* @Function: position of a checkpoint in its chain, sequence 0 is a full checkpoint and
+* sequence k the k-th delta after it, generation tells the chains apart.
+*/
+struct Chain {
+	int64_t generation;
+	int32_t sequence;
+};
+
+inline std::string deltaPath(const std::string& path, int32_t sequence) {
+	return path + ".delta." + std::to_string(sequence);
+}
+
+/**
+* @Function: write a live matrix in the Matrix::save layout, chunk by chunk through a private buffer,
+* the dirty flags of a chunk are cleared before it is copied so later writes go to the next delta.
+*/
+void saveMatrix(std::ostream& out, Matrix& m, std::vector<real>& buffer) {
+	int64_t rows = m.rows();
+	int64_t cols = m.cols();
+	out.write((char*)&rows, sizeof(int64_t));
+	out.write((char*)&cols, sizeof(int64_t));
+	const int64_t chunk = std::max<int64_t>(1, CHUNK_BYTES / std::max<int64_t>(1, cols * sizeof(real)));
+	buffer.resize(chunk * cols);
+	for (int64_t i = 0; i < rows; i += chunk) {
+		int64_t n = std::min(chunk, rows - i);
+		m.clearDirty(i, i + n);
+		std::memcpy(buffer.data(), m.row(i), n * cols * sizeof(real));
+		out.write((char*)buffer.data(), n * cols * sizeof(real));
+	}
+}
+
+/**
+* @Function: write the rows flagged dirty as chunks of row ids and values, a chunk of 0 rows ends the matrix.
+*/
+void saveDirtyRows(std::ostream& out, Matrix& m, std::vector<real>& buffer) {
+	const int64_t cols = m.cols();
+	const int64_t chunk = std::max<int64_t>(1, CHUNK_BYTES / std::max<int64_t>(1, cols * sizeof(real)));
+	std::vector<int64_t> ids;
+	buffer.resize(chunk * cols);
+	for (int64_t i = 0; i <= m.rows(); i++) {
+		if (i < m.rows() && m.takeDirty(i)) {
+			std::memcpy(buffer.data() + ids.size() * cols, m.row(i), cols * sizeof(real));
+			ids.push_back(i);
+		}
+		if (int64_t(ids.size()) == chunk || (i == m.rows() && !ids.empty())) {
+			int64_t n = ids.size();
+			out.write((char*)&n, sizeof(int64_t));
+			out.write((char*)ids.data(), n * sizeof(int64_t));
+			out.write((char*)buffer.data(), n * cols * sizeof(real));
+			ids.clear();
+		}
+	}
+	int64_t end = 0;
+	out.write((char*)&end, sizeof(int64_t));
+}
+
+/**
+* @Function: apply the rows written by saveDirtyRows.
+*/
+void loadDirtyRows(std::istream& in, Matrix& m) {
+	const int64_t cols = m.cols();
+	std::vector<int64_t> ids;
+	int64_t n = 0;
+	while (in.read((char*)&n, sizeof(int64_t)) && n > 0) {
+		ids.resize(n);
+		in.read((char*)ids.data(), n * sizeof(int64_t));
+		for (int64_t i = 0; i < n; i++) {
+			if (ids[i] < 0 || ids[i] >= m.rows()) {
+				throw std::invalid_argument("checkpoint delta row out of range.");
+			}
+			in.read((char*)m.row(ids[i]), cols * sizeof(real));
+		}
+	}
+}
+
+/**
+* @Function: rename tmp over path.
+*/
+void commit(std::ofstream& ofs, const std::string& tmp, const std::string& path) {
+	ofs.close();
+	if (!ofs) {
+		throw std::invalid_argument(tmp + " could not be written.");
+	}
+	if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+		throw std::invalid_argument(tmp + " cannot be renamed to " + path);
+	}
+}
+
+/**
+* @Function: write a full checkpoint to path.tmp and rename it over path, so path is always a complete
+* checkpoint, then drop the deltas of the previous chain.
+*/
+void save(const std::string& path, Args& args, const Dictionary& dict,
+		Matrix& input, Matrix& output, const Progress& progress, const Chain& chain) {
+	const std::string tmp = path + ".tmp";
+	std::ofstream ofs(tmp, std::ios::binary);
+	if (!ofs.is_open()) {
+		throw std::invalid_argument(tmp + " cannot be opened for saving the checkpoint.");
+	}
+	std::vector<real> buffer;
+	ofs.write(MAGIC, sizeof(MAGIC));
+	ofs.write((char*)&chain.generation, sizeof(int64_t));
+	args.save(ofs);
+	dict.save(ofs);
+	saveProgress(ofs, progress);
+	saveMatrix(ofs, input, buffer);
+	saveMatrix(ofs, output, buffer);
+	commit(ofs, tmp, path);
+	for (int32_t k = 1; std::remove(deltaPath(path, k).c_str()) == 0; k++) {
+	}
+}
+
+/**
+* @Function: write the rows changed since the previous checkpoint of the chain to path.delta.k.
+*/
+void saveDelta(const std::string& path, Matrix& input, Matrix& output,
+		const Progress& progress, const Chain& chain) {
+	const std::string file = deltaPath(path, chain.sequence);
+	const std::string tmp = file + ".tmp";
+	std::ofstream ofs(tmp, std::ios::binary);
+	if (!ofs.is_open()) {
+		throw std::invalid_argument(tmp + " cannot be opened for saving the checkpoint.");
+	}
+	std::vector<real> buffer;
+	ofs.write(DELTA_MAGIC, sizeof(DELTA_MAGIC));
+	ofs.write((char*)&chain.generation, sizeof(int64_t));
+	ofs.write((char*)&chain.sequence, sizeof(int32_t));
+	saveProgress(ofs, progress);
+	saveDirtyRows(ofs, input, buffer);
+	saveDirtyRows(ofs, output, buffer);
+	commit(ofs, tmp, file);
+}
+
+/**
+* @Function: apply path.delta.1, path.delta.2, ... of the given generation, returns the deltas applied.
+*/
+int32_t loadDeltas(const std::string& path, int64_t generation, Matrix& input, Matrix& output, Progress& progress) {
+	int32_t k = 1;
+	for (; ; k++) {
+		std::ifstream in(deltaPath(path, k), std::ios::binary);
+		if (!in.is_open()) {
+			break;
+		}
+		char magic[sizeof(DELTA_MAGIC)];
+		int64_t g = 0;
+		int32_t sequence = 0;
+		in.read(magic, sizeof(magic));
+		in.read((char*)&g, sizeof(int64_t));
+		in.read((char*)&sequence, sizeof(int32_t));
+		// a delta left over from an older chain is ignored
+		if (!in || std::memcmp(magic, DELTA_MAGIC, sizeof(DELTA_MAGIC)) != 0 || g != generation || sequence != k) {
+			break;
+		}
+		loadProgress(in, progress);
+		loadDirtyRows(in, input);
+		loadDirtyRows(in, output);
+		if (!in) {
+			throw std::invalid_argument(deltaPath(path, k) + " is truncated.");
+		}
+	}
+	return k - 1;
+}
+
+/**
+* @Function: open a checkpoint and check its magic, the stream is left at the args.
+*/
+void open(const std::string& path, std::ifstream& in, int64_t& generation) {
+	in.open(path, std::ios::binary);
+	if (!in.is_open()) {
+		throw std::invalid_argument(path + " cannot be opened for resuming.");
+	}
+	char magic[sizeof(MAGIC)];
+	in.read(magic, sizeof(magic));
+	if (!in || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+		throw std::invalid_argument(path + " is not a checkpoint.");
+	}
+	in.read((char*)&generation, sizeof(int64_t));
+}
+
+}
+
+/**
+* @Function: runs one checkpoint at a time on a background thread, a full checkpoint
+* after every maxDeltas deltas, or always full when maxDeltas is 0.
+*/
+class Checkpointer {
+  protected:
+	std::thread worker_;
+	std::atomic<bool> busy_;
+	int64_t last_;
+	int64_t interval_;
+	int32_t maxDeltas_;
+	checkpoint::Chain chain_;
+
+  public:
+	Checkpointer(double, int32_t, int64_t);
+	~Checkpointer();
+
+	bool due(int64_t) const;
+	bool start(int64_t, std::function<void(const checkpoint::Chain&)>);
+	void wait();
+};
+
+/**
+* @Function: initial Checkpointer class argument, interval in seconds and start time in ns.
+*/
+Checkpointer::Checkpointer(double interval, int32_t maxDeltas, int64_t now) : busy_(false), last_(now),
+	interval_(int64_t(interval * 1e9)), maxDeltas_(maxDeltas) {
+	chain_.generation = 0;
+	chain_.sequence = -1;
+}
+
+Checkpointer::~Checkpointer() {
+	wait();
+}
+
+/**
+* @Function: whether the interval has passed since the last checkpoint, time in ns.
+*/
+bool Checkpointer::due(int64_t now) const {
+	return !busy_.load() && now - last_ >= interval_;
+}
+
+/**
+* @Function: run write on the background thread unless a checkpoint is still being written,
+* write gets the place of the checkpoint in the chain.
+*/
+bool Checkpointer::start(int64_t now, std::function<void(const checkpoint::Chain&)> write) {
+	if (busy_.load()) {
+		return false;
+	}
+	if (worker_.joinable()) {
+		worker_.join();
+	}
+	last_ = now;
+	if (chain_.sequence < 0 || chain_.sequence >= maxDeltas_) {
+		// the full checkpoint replaces the delta chain, which compacts it
+		chain_.generation = now;
+		chain_.sequence = 0;
+	} else {
+		chain_.sequence++;
+	}
+	checkpoint::Chain chain = chain_;
+	busy_ = true;
+	worker_ = std::thread([this, write, chain]() {
+		try {
+			write(chain);
+		} catch (const std::exception& e) {
+			std::cerr << "\ncheckpoint failed: " << e.what() << std::endl;
+			// the next checkpoint starts a new chain
+			chain_.sequence = -1;
+		}
+		busy_ = false;
+	});
+	return true;
+}
+
+/**
+* @Function: wait for the checkpoint being written.
+*/
+void Checkpointer::wait() {
+	if (worker_.joinable()) {
+		worker_.join();
+	}
+}
@@ -11,6 +11,9 @@
 #include "args.h"
 #include "real.h"
 #include "alphabet.h"
+#include "random.h"
+#include "profiler.h"
+#include "memreport.h"
 
 #include <random>
 #include <memory>
@@ -57,6 +60,8 @@ class Dictionary {
 	void initNgrams();
 
 	void reset(std::istream&) const;
+	static void saveAlphabet(std::ostream&, const alphabet&);
+	static void loadAlphabet(std::istream&, alphabet&);
 
 	std::shared_ptr<Args> args_;
 	alphabet words_;
@@ -64,11 +69,14 @@ class Dictionary {
 	std::vector<entry> wordprops_;
 	std::vector<feature> featureinitial_;
 	std::map<std::string, std::string> featuremap;
-	std::map<std::string, std::string> ::iterator featpos;
 	alphabet features_;
 	alphabet targets_;
-	std::vector<real> pdiscard_;
+	std::vector<uint32_t> pdiscard_;
 	int64_t ntokens_;
+	// tokens of the corpus being trained, ntokens_ counts every corpus merged in for the discard table
+	int64_t ntrain_;
+
+	void merge(const alphabet&, int64_t);
 
 public:
 	static const std::string EOS;
@@ -82,6 +90,7 @@ public:
 	int32_t ntargets() const;
 	int32_t nfeatures() const;
 	int64_t ntokens() const;
+	int64_t ntrainTokens() const;
 	int32_t getWordId(const std::string&) const;
 	int32_t getWord_RadicalId(const std::string&) const;
 	int32_t getTargetId(const std::string&) const;
@@ -90,10 +99,12 @@ public:
 	std::string getWord_Radical(int32_t) const;
 	std::string getTarget(int32_t) const;
 	std::string getFeature(int32_t) const;
-	std::string getFeat(std::string);
-	void trim(std::string&);
+	std::string getFeat(std::string) const;
+	void trim(std::string&) const;
 
 	std::vector<int64_t> getCounts() const;
+	std::vector<int64_t> getFeatureCounts() const;
+	std::vector<int64_t> getTargetCounts() const;
 	void computeSubwords(const std::string&, std::vector<std::string>&) const;
 	void computeSubwords(const std::string&, std::vector<int32_t>&) const;
 
@@ -104,17 +115,24 @@ public:
 	//subfeature
 	void computerSubfeat(const std::string&, std::vector<std::string>&) const;
 	void computerSubfeat(const std::string&, std::vector<int32_t>&) const;
+	void getSubwords(const std::string&, std::vector<std::string>&) const;
+
+	void memoryReport(MemReport&) const;
 
 	void initTableDiscard();
-	bool discard(int32_t, real) const;
+	bool discard(int32_t, uint32_t) const;
 
 	bool readWord(std::istream&, std::string&) const;
 	void readFeature(std::istream&);
 	void readFromFile(std::istream&);
 	void readFromFile(std::istream&, std::istream&);
+	void save(std::ostream&) const;
+	void load(std::istream&);
+	void update(std::istream&);
+	void update(std::istream&, std::istream&);
 	//int32_t getLine(std::istream&, std::vector<int32_t>&, std::minstd_rand&) const;
-	int32_t getLine(std::istream&, std::vector<std::vector<int32_t> >&, std::vector<std::vector<int32_t> >&, std::vector<int32_t>&, std::minstd_rand&) const;
-	int32_t getLine_zh(std::istream&, std::vector<std::vector<int32_t> >&, std::vector<std::vector<int32_t> >&, std::vector<int32_t>&, std::minstd_rand&) const;
+	int32_t getLine(std::istream&, std::vector<std::vector<int32_t> >&, std::vector<std::vector<int32_t> >&, std::vector<int32_t>&, rng::engine&) const;
+	int32_t getLine_zh(std::istream&, std::vector<std::vector<int32_t> >&, std::vector<std::vector<int32_t> >&, std::vector<int32_t>&, rng::engine&) const;
 };
 
 const std::string Dictionary::EOS = "</s>";
@@ -124,7 +142,7 @@ const std::string Dictionary::EOW = ">";
 /**
 * @Function: initial Dictionary class argument.
 */
-Dictionary::Dictionary(std::shared_ptr<Args> args) : args_(args) {
+Dictionary::Dictionary(std::shared_ptr<Args> args) : args_(args), ntokens_(0), ntrain_(0) {
 	words_.setCapacity(MAX_VOCAB_SIZE - 1);
 	word_radical_.setCapacity(MAX_VOCAB_SIZE - 1);
 	features_.setCapacity(MAX_VOCAB_SIZE - 1);
@@ -378,7 +396,7 @@ void Dictionary::initFeature() {
 /**
 * @Function: erase the empty space
 */
-void Dictionary::trim(std::string& s) {
+void Dictionary::trim(std::string& s) const {
 	int index = 0;
 	if (!s.empty())
 	{
@@ -392,14 +410,14 @@ void Dictionary::trim(std::string& s) {
 /**
 * @Function: get feature from feature map in dictionary.
 */
-std::string Dictionary::getFeat(std::string word) {
+std::string Dictionary::getFeat(std::string word) const {
 	/*std::string pad;
 	if (args_->model == model_name::subradical) {
 		pad = args_->radicalpad;
 	} else if (args_->model == model_name::subcomponent) {
 		pad = args_->componentpad;
 	}*/
-	featpos = featuremap.find(word);
+	auto featpos = featuremap.find(word);
 	//std::cout << word << endl;
 	std::string feat;
 	if (featpos != featuremap.end()) {
@@ -509,6 +527,22 @@ void Dictionary::computeSubwords(const std::string& word, std::vector<int32_t>&
 	}
 }
 
+/**
+* @Function: feature strings of any word by the rules of the model, the ngrams of subword or the
+* ngrams of the features of subradical and subcomponent, none for the other models.
+*/
+void Dictionary::getSubwords(const std::string& word, std::vector<std::string>& substrings) const {
+	substrings.clear();
+	if (word == EOS) {
+		return;
+	}
+	if (args_->model == model_name::subword) {
+		computeSubwords(BOW + word + EOW, substrings);
+	} else if (args_->model == model_name::subradical || args_->model == model_name::subcomponent) {
+		computerSubfeat(BOW + getFeat(word) + EOW, substrings);
+	}
+}
+
 /**
 * @Function: ntokens count.
 */
@@ -516,6 +550,13 @@ int64_t Dictionary::ntokens() const {
 	return ntokens_;
 }
 
+/**
+* @Function: tokens of the corpus being trained, the new corpus after an update.
+*/
+int64_t Dictionary::ntrainTokens() const {
+	return ntrain_;
+}
+
 /**
 * @Function: Ngrams initial.
 */
@@ -590,6 +631,25 @@ void Dictionary::initNgrams() {
 	}
 }
 
+/**
+* @Function: account the alphabets and tables of the dictionary.
+*/
+void Dictionary::memoryReport(MemReport& report) const {
+	report.add("dictionary.words_", words_.memoryUsage());
+	report.add("dictionary.targets_", targets_.memoryUsage());
+	report.add("dictionary.features_", features_.memoryUsage());
+	report.add("dictionary.word_radical_", word_radical_.memoryUsage());
+	int64_t props = sizeof(wordprops_) + (wordprops_.capacity() - wordprops_.size()) * sizeof(entry);
+	for (size_t i = 0; i < wordprops_.size(); i++) {
+		props += sizeof(entry) - sizeof(std::string) + memreport::bytes(wordprops_[i].word)
+			+ wordprops_[i].subwords.capacity() * sizeof(int32_t)
+			+ wordprops_[i].subword_radicals.capacity() * sizeof(int32_t);
+	}
+	report.add("dictionary.wordprops_", props);
+	report.add("dictionary.featuremap", memreport::bytes(featuremap));
+	report.add("dictionary.pdiscard_", memreport::bytes(pdiscard_));
+}
+
 /**
 * @Function: TableDiscard initial.
 */
@@ -597,14 +657,14 @@ void Dictionary::initTableDiscard() {
 	pdiscard_.resize(words_.m_size);
 	for (size_t i = 0; i < words_.m_size; i++) {
 		real f = real(wordprops_[i].count) / real(ntokens_);
-		pdiscard_[i] = std::sqrt(args_->t / f) + args_->t / f;
+		pdiscard_[i] = rng::threshold(std::sqrt(args_->t / f) + args_->t / f);
 	}
 }
 
 /**
-* @Function: None.
+* @Function: subsampling, rand is a raw 32 bits draw.
 */
-bool Dictionary::discard(int32_t id, real rand) const {
+bool Dictionary::discard(int32_t id, uint32_t rand) const {
 	assert(id >= 0);
 	assert(id < words_.m_size);
 
@@ -673,6 +733,7 @@ void Dictionary::readFromFile(std::istream& in) {
 	}
 
 	words_.prune(args_->minCount);
+	ntrain_ = ntokens_;
 
 	if (args_->model == model_name::subchar_chinese) {
 		word_radical_.prune(args_->minCount);
@@ -709,6 +770,7 @@ void Dictionary::readFromFile(std::istream& in, std::istream& infeature) {
 		}
 	}
 	words_.prune(args_->minCount);
+	ntrain_ = ntokens_;
 
 	//read feature file
 	readFeature(infeature);
@@ -775,12 +837,25 @@ std::vector<int64_t> Dictionary::getCounts() const {
 	return counts;
 }
 
+/**
+* @Function: feature counts in id order.
+*/
+std::vector<int64_t> Dictionary::getFeatureCounts() const {
+	return std::vector<int64_t>(features_.m_id_to_freq.begin(), features_.m_id_to_freq.begin() + features_.m_size);
+}
+
+/**
+* @Function: target counts in id order.
+*/
+std::vector<int64_t> Dictionary::getTargetCounts() const {
+	return std::vector<int64_t>(targets_.m_id_to_freq.begin(), targets_.m_id_to_freq.begin() + targets_.m_size);
+}
+
 /**
 * @Function: getLine.
 */
 int32_t Dictionary::getLine(std::istream& in, std::vector<std::vector<int32_t> >& sourceTypes,
-	std::vector<std::vector<int32_t> >& sources, std::vector<int32_t>& targets, std::minstd_rand& rng) const {
-	std::uniform_real_distribution<> uniform(0, 1);
+	std::vector<std::vector<int32_t> >& sources, std::vector<int32_t>& targets, rng::engine& rng) const {
 	std::string token;
 	vector<string> words;
 	int32_t ntokens = 0;
@@ -790,20 +865,42 @@ int32_t Dictionary::getLine(std::istream& in, std::vector<std::vector<int32_t> >
 	sources.clear();
 	targets.clear();
 	words.clear();
-	while (readWord(in, token)) {
-		if (token == EOS)
-			break;
-		words.push_back(token);
+	{
+		profiler::Scope scope(profiler::READ_WORD);
+		while (readWord(in, token)) {
+			if (token == EOS)
+				break;
+			words.push_back(token);
+		}
 	}
 
 	int word_num = words.size();
 	int valid = 0;
+	// subsampling draws of the whole line at once
+	static thread_local std::vector<uint32_t> draws;
+	{
+		profiler::Scope scope(profiler::SUBSAMPLE);
+		draws.resize(word_num);
+		rng::fill(rng, draws.data(), word_num);
+	}
 	
 	for (int i = 0; i < word_num; i++) {
-		int32_t wid = findWord(words[i]);
-		int32_t tid = findTarget(words[i]);
+		int32_t wid;
+		int32_t tid;
+		{
+			profiler::Scope scope(profiler::LOOKUP);
+			wid = findWord(words[i]);
+			tid = findTarget(words[i]);
+		}
 		ntokens++;
-		if (wid < 0 || tid < 0 || discard(wid, uniform(rng)))
+		if (wid < 0 || tid < 0)
+			continue;
+		bool drop;
+		{
+			profiler::Scope scope(profiler::SUBSAMPLE);
+			drop = discard(wid, draws[i]);
+		}
+		if (drop)
 			continue;
 		valid++;
 		sourceTypes.push_back(std::vector<int32_t>());
@@ -831,8 +928,7 @@ int32_t Dictionary::getLine(std::istream& in, std::vector<std::vector<int32_t> >
 */
 int32_t Dictionary::getLine_zh(std::istream& in, std::vector<std::vector<int32_t> >& sourceTypes,
 	std::vector<std::vector<int32_t> >& sources,
-	std::vector<int32_t>& targets, std::minstd_rand& rng) const {
-	std::uniform_real_distribution<> uniform(0, 1);
+	std::vector<int32_t>& targets, rng::engine& rng) const {
 	std::string token;
 	vector<string> words;
 	int32_t ntokens = 0;
@@ -842,14 +938,24 @@ int32_t Dictionary::getLine_zh(std::istream& in, std::vector<std::vector<int32_t
 	sources.clear();
 	targets.clear();
 	words.clear();
-	while (readWord(in, token)) {
-		if (token == EOS)
-			break;
-		words.push_back(token);
+	{
+		profiler::Scope scope(profiler::READ_WORD);
+		while (readWord(in, token)) {
+			if (token == EOS)
+				break;
+			words.push_back(token);
+		}
 	}
 
 	int word_num = words.size();
 	int valid = 0;
+	// subsampling draws of the whole line at once
+	static thread_local std::vector<uint32_t> draws;
+	{
+		profiler::Scope scope(profiler::SUBSAMPLE);
+		draws.resize(word_num);
+		rng::fill(rng, draws.data(), word_num);
+	}
 
 	for (int i = 0; i < word_num; i++) {
 		std::string word_radical = words[i];
@@ -862,10 +968,22 @@ int32_t Dictionary::getLine_zh(std::istream& in, std::vector<std::vector<int32_t
 		}
 		std::string word = word_radical.substr(0, pos_);
 		std::string radical = word_radical.substr(pos_ + 1);
-		int32_t wid = findWord(word);
-		int32_t tid = findTarget(word);
+		int32_t wid;
+		int32_t tid;
+		{
+			profiler::Scope scope(profiler::LOOKUP);
+			wid = findWord(word);
+			tid = findTarget(word);
+		}
 		ntokens++;
-		if (wid < 0 || tid < 0 || discard(wid, uniform(rng)))
+		if (wid < 0 || tid < 0)
+			continue;
+		bool drop;
+		{
+			profiler::Scope scope(profiler::SUBSAMPLE);
+			drop = discard(wid, draws[i]);
+		}
+		if (drop)
 			continue;
 		valid++;
 		sourceTypes.push_back(std::vector<int32_t>());
@@ -887,4 +1005,155 @@ int32_t Dictionary::getLine_zh(std::istream& in, std::vector<std::vector<int32_t
 			break;
 	}
 	return ntokens;
-}
\ No newline at end of file
+}
+
+/**
+* @Function: save the strings and counts of an alphabet in id order.
+*/
+void Dictionary::saveAlphabet(std::ostream& out, const alphabet& a) {
+	int32_t size = a.m_size;
+	out.write((char*)&size, sizeof(int32_t));
+	for (int32_t i = 0; i < size; i++) {
+		const std::string& s = a.m_id_to_string[i];
+		int32_t n = s.size();
+		out.write((char*)&n, sizeof(int32_t));
+		out.write(s.data(), n);
+		out.write((char*)&a.m_id_to_freq[i], sizeof(int64_t));
+	}
+}
+
+/**
+* @Function: load an alphabet written by saveAlphabet, ids are kept.
+*/
+void Dictionary::loadAlphabet(std::istream& in, alphabet& a) {
+	int32_t size = 0;
+	in.read((char*)&size, sizeof(int32_t));
+	a.clear();
+	std::string s;
+	for (int32_t i = 0; i < size; i++) {
+		int32_t n = 0;
+		int64_t freq = 0;
+		in.read((char*)&n, sizeof(int32_t));
+		s.resize(n);
+		in.read(&s[0], n);
+		in.read((char*)&freq, sizeof(int64_t));
+		a.add_string(s, freq);
+	}
+}
+
+/**
+* @Function: save the words and the feature map, the features and targets are derived from them.
+*/
+void Dictionary::save(std::ostream& out) const {
+	out.write((char*)&ntokens_, sizeof(int64_t));
+	out.write((char*)&ntrain_, sizeof(int64_t));
+	saveAlphabet(out, words_);
+	saveAlphabet(out, word_radical_);
+	int32_t size = featuremap.size();
+	out.write((char*)&size, sizeof(int32_t));
+	for (auto it = featuremap.cbegin(); it != featuremap.cend(); ++it) {
+		int32_t n = it->first.size();
+		out.write((char*)&n, sizeof(int32_t));
+		out.write(it->first.data(), n);
+		n = it->second.size();
+		out.write((char*)&n, sizeof(int32_t));
+		out.write(it->second.data(), n);
+	}
+}
+
+/**
+* @Function: load a dictionary written by save, rebuilding features, targets, ngrams and the discard table.
+*/
+void Dictionary::load(std::istream& in) {
+	in.read((char*)&ntokens_, sizeof(int64_t));
+	in.read((char*)&ntrain_, sizeof(int64_t));
+	loadAlphabet(in, words_);
+	loadAlphabet(in, word_radical_);
+	int32_t size = 0;
+	in.read((char*)&size, sizeof(int32_t));
+	featuremap.clear();
+	std::string key;
+	std::string value;
+	for (int32_t i = 0; i < size; i++) {
+		int32_t n = 0;
+		in.read((char*)&n, sizeof(int32_t));
+		key.resize(n);
+		in.read(&key[0], n);
+		in.read((char*)&n, sizeof(int32_t));
+		value.resize(n);
+		in.read(&value[0], n);
+		featuremap[key] = value;
+	}
+	features_.clear();
+	targets_.clear();
+	initFeature();
+	initTargets();
+	initNgrams();
+	initTableDiscard();
+}
+
+/**
+* @Function: merge the counts of a new corpus, known words keep their ids and add the new counts,
+* new words are appended when they pass minCount as in alphabet::prune, then the features, targets,
+* ngrams and discard table are rebuilt, which appends the new features after the known ones.
+*/
+void Dictionary::merge(const alphabet& fresh, int64_t ntokens) {
+	const int32_t nwords = words_.m_size;
+	for (int32_t i = 0; i < fresh.m_size; i++) {
+		const std::string& w = fresh.m_id_to_string[i];
+		int64_t freq = fresh.m_id_to_freq[i];
+		if (words_.from_string(w) >= 0 || args_->minCount <= 1 || freq > args_->minCount) {
+			words_.add_string(w, freq);
+		}
+	}
+	ntokens_ += ntokens;
+	ntrain_ = ntokens;
+	features_.clear();
+	targets_.clear();
+	initFeature();
+	initTargets();
+	initNgrams();
+	initTableDiscard();
+	if (args_->verbose > 0) {
+		std::cerr << "\rRead " << ntokens / 1000000 << "M new words" << std::endl;
+		std::cerr << "Number of all words:  " << ntokens_ << std::endl;
+		std::cerr << "Number of words:  " << words_.m_size << " (" << words_.m_size - nwords << " new)" << std::endl;
+		std::cerr << "Number of features: " << features_.m_size << std::endl;
+		std::cerr << "Number of targets: " << targets_.m_size << std::endl;
+	}
+}
+
+/**
+* @Function: count a new corpus and merge it into the dictionary.
+*/
+void Dictionary::update(std::istream& in) {
+	if (args_->model == model_name::subchar_chinese) {
+		throw std::invalid_argument("update does not support the subchar_chinese model.");
+	}
+	alphabet fresh;
+	fresh.setCapacity(MAX_VOCAB_SIZE - 1);
+	std::string word;
+	int64_t ntokens = 0;
+	while (readWord(in, word)) {
+		fresh.add_string(word);
+		ntokens++;
+		if (ntokens % 1000000 == 0 && args_->verbose > 1) {
+			std::cerr << "\rRead " << ntokens / 1000000 << "M new words" << std::flush;
+		}
+	}
+	merge(fresh, ntokens);
+}
+
+/**
+* @Function: merge a new feature file and a new corpus, the known words keep their features so
+* their feature ids stay the same.
+*/
+void Dictionary::update(std::istream& in, std::istream& infeature) {
+	std::map<std::string, std::string> known;
+	known.swap(featuremap);
+	readFeature(infeature);
+	for (auto it = known.cbegin(); it != known.cend(); ++it) {
+		featuremap[it->first] = it->second;
+	}
+	update(in);
+}
@@ -0,0 +1,433 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: evaluation.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: word analogy and word similarity benchmarks answered in batches over normalized vectors.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <functional>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "matrix.h"
+#include "neighbors.h"
+#include "kernels.h"
+#include "real.h"
+#include "utils.h"
+
+namespace evaluation {
+
+/**
+* @Function: "a b c d" asks for d = b - a + c, the section is the index of the last ": name" line.
+*/
+struct Question {
+	std::string words[4];
+	int32_t section;
+};
+
+/**
+* @Function: "w1 w2 score" of a similarity set.
+*/
+struct Pair {
+	std::string first;
+	std::string second;
+	double gold;
+};
+
+struct Section {
+	std::string name;
+	int64_t correct;
+	int64_t total;
+};
+
+/**
+* @Function: the scores of one evaluation, questions and pairs with an unknown word are skipped.
+*/
+struct Report {
+	std::vector<Section> sections;
+	int64_t correct;
+	int64_t questions;
+	int64_t skippedQuestions;
+	double spearman;
+	int64_t pairs;
+	int64_t skippedPairs;
+
+	inline double accuracy() const {
+		return questions > 0 ? double(correct) / questions : 0;
+	}
+};
+
+/**
+* @Function: ranks of the values from 1, tied values share the average of their ranks.
+*/
+std::vector<double> ranks(const std::vector<double>& values) {
+	std::vector<int64_t> order(values.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&](int64_t a, int64_t b) {
+		return values[a] < values[b];
+	});
+	std::vector<double> r(values.size());
+	for (size_t i = 0; i < order.size();) {
+		size_t j = i;
+		while (j + 1 < order.size() && values[order[j + 1]] == values[order[i]]) {
+			j++;
+		}
+		for (size_t t = i; t <= j; t++) {
+			r[order[t]] = (i + j) / 2.0 + 1;
+		}
+		i = j + 1;
+	}
+	return r;
+}
+
+/**
+* @Function: Spearman correlation, the Pearson correlation of the ranks, 0 for fewer than two values.
+*/
+double spearman(const std::vector<double>& x, const std::vector<double>& y) {
+	const size_t n = x.size();
+	if (n < 2 || y.size() != n) {
+		return 0;
+	}
+	std::vector<double> rx = ranks(x);
+	std::vector<double> ry = ranks(y);
+	const double mean = (n + 1) / 2.0;
+	double sxy = 0, sxx = 0, syy = 0;
+	for (size_t i = 0; i < n; i++) {
+		sxy += (rx[i] - mean) * (ry[i] - mean);
+		sxx += (rx[i] - mean) * (rx[i] - mean);
+		syy += (ry[i] - mean) * (ry[i] - mean);
+	}
+	return sxx > 0 && syy > 0 ? sxy / std::sqrt(sxx * syy) : 0;
+}
+
+}
+
+/**
+* @Function: the analogy and similarity sets are read once and evaluated on any normalized vectors,
+* all the analogy questions are one batched top-1 search that skips the three words of each question.
+*/
+class Evaluator {
+  protected:
+	std::vector<std::string> sections_;
+	std::vector<evaluation::Question> questions_;
+	std::vector<evaluation::Pair> pairs_;
+
+  public:
+	Evaluator(const std::string&, const std::string&);
+
+	inline bool empty() const {
+		return questions_.empty() && pairs_.empty();
+	}
+	inline bool hasAnalogy() const {
+		return !questions_.empty();
+	}
+	evaluation::Report evaluate(const NearestNeighbors&, int32_t) const;
+	static void print(const evaluation::Report&, std::ostream&);
+};
+
+/**
+* @Function: read the analogy questions and the similarity pairs, either path may be empty.
+*/
+Evaluator::Evaluator(const std::string& analogy, const std::string& similarity) {
+	std::string line;
+	if (analogy != "") {
+		std::ifstream ifs(analogy);
+		if (!ifs.is_open()) {
+			throw std::invalid_argument(analogy + " cannot be opened for evaluation.");
+		}
+		sections_.push_back("");
+		while (std::getline(ifs, line)) {
+			std::istringstream fields(line);
+			evaluation::Question q;
+			if (!(fields >> q.words[0])) {
+				continue;
+			}
+			if (q.words[0] == ":") {
+				std::string name;
+				fields >> name;
+				// questions before the first section line stay in the unnamed one
+				if (sections_.size() == 1 && sections_[0] == "" && questions_.empty()) {
+					sections_[0] = name;
+				} else {
+					sections_.push_back(name);
+				}
+				continue;
+			}
+			if (!(fields >> q.words[1] >> q.words[2] >> q.words[3])) {
+				continue;
+			}
+			q.section = sections_.size() - 1;
+			questions_.push_back(q);
+		}
+	}
+	if (similarity != "") {
+		std::ifstream ifs(similarity);
+		if (!ifs.is_open()) {
+			throw std::invalid_argument(similarity + " cannot be opened for evaluation.");
+		}
+		while (std::getline(ifs, line)) {
+			std::istringstream fields(line);
+			evaluation::Pair p;
+			// comments and header lines have no numeric third field
+			if (line.empty() || line[0] == '#' || !(fields >> p.first >> p.second >> p.gold)) {
+				continue;
+			}
+			pairs_.push_back(p);
+		}
+	}
+}
+
+/**
+* @Function: accuracy of the analogies by 3CosAdd and Spearman correlation of the similarities.
+*/
+evaluation::Report Evaluator::evaluate(const NearestNeighbors& nn, int32_t threads) const {
+	threads = std::max(threads, 1);
+	evaluation::Report report;
+	report.correct = 0;
+	report.questions = 0;
+	report.skippedQuestions = 0;
+	report.spearman = 0;
+	report.pairs = 0;
+	report.skippedPairs = 0;
+	for (size_t s = 0; s < sections_.size(); s++) {
+		evaluation::Section section = { sections_[s], 0, 0 };
+		report.sections.push_back(section);
+	}
+
+	const Matrix& unit = nn.vectors();
+	const int64_t dim = nn.dim();
+	std::vector<std::vector<int64_t>> ids;
+	std::vector<int64_t> answers;
+	std::vector<int32_t> sections;
+	for (size_t i = 0; i < questions_.size(); i++) {
+		std::vector<int64_t> q(4);
+		bool known = true;
+		for (int32_t j = 0; j < 4; j++) {
+			q[j] = nn.find(questions_[i].words[j]);
+			known = known && q[j] >= 0;
+		}
+		if (!known) {
+			report.skippedQuestions++;
+			continue;
+		}
+		answers.push_back(q[3]);
+		sections.push_back(questions_[i].section);
+		q.pop_back();
+		ids.push_back(q);
+	}
+	if (!ids.empty()) {
+		const int64_t n = ids.size();
+		Matrix queries(n, dim);
+		utils::parallel(threads, [&](int32_t t) {
+			for (int64_t i = n * t / threads; i < n * (t + 1) / threads; i++) {
+				real* q = queries.row(i);
+				std::memcpy(q, unit.row(ids[i][1]), dim * sizeof(real));
+				kernels::axpy<0>(q, real(-1.0), unit.row(ids[i][0]), dim);
+				kernels::add<0>(q, unit.row(ids[i][2]), dim);
+			}
+		});
+		std::vector<std::vector<neighbors::Neighbor>> results;
+		nn.search(queries, 1, ids, results);
+		for (int64_t i = 0; i < n; i++) {
+			const bool hit = !results[i].empty() && results[i][0].id == answers[i];
+			report.sections[sections[i]].total++;
+			report.sections[sections[i]].correct += hit ? 1 : 0;
+			report.correct += hit ? 1 : 0;
+		}
+		report.questions = n;
+	}
+
+	std::vector<std::pair<int64_t, int64_t>> pairs;
+	std::vector<double> gold;
+	for (size_t i = 0; i < pairs_.size(); i++) {
+		int64_t a = nn.find(pairs_[i].first);
+		int64_t b = nn.find(pairs_[i].second);
+		if (a < 0 || b < 0) {
+			report.skippedPairs++;
+			continue;
+		}
+		pairs.push_back(std::make_pair(a, b));
+		gold.push_back(pairs_[i].gold);
+	}
+	if (!pairs.empty()) {
+		const int64_t n = pairs.size();
+		std::vector<double> cosine(n);
+		utils::parallel(threads, [&](int32_t t) {
+			for (int64_t i = n * t / threads; i < n * (t + 1) / threads; i++) {
+				cosine[i] = kernels::dot<0>(unit.row(pairs[i].first), unit.row(pairs[i].second), dim);
+			}
+		});
+		report.spearman = evaluation::spearman(gold, cosine);
+		report.pairs = n;
+	}
+	return report;
+}
+
+/**
+* @Function: one line per analogy section, the total and the similarity score.
+*/
+void Evaluator::print(const evaluation::Report& report, std::ostream& out) {
+	out << std::fixed << std::setprecision(2);
+	for (size_t s = 0; s < report.sections.size(); s++) {
+		const evaluation::Section& section = report.sections[s];
+		if (section.total == 0) {
+			continue;
+		}
+		out << "analogy " << (section.name == "" ? "-" : section.name) << ": "
+			<< 100.0 * section.correct / section.total << "% (" << section.correct << "/" << section.total << ")\n";
+	}
+	if (report.questions + report.skippedQuestions > 0) {
+		out << "analogy total: " << 100.0 * report.accuracy() << "% (" << report.correct << "/" << report.questions
+			<< "), " << report.skippedQuestions << " questions with unknown words\n";
+	}
+	if (report.pairs + report.skippedPairs > 0) {
+		out << "similarity spearman: " << std::setprecision(4) << report.spearman << " (" << report.pairs
+			<< " pairs), " << report.skippedPairs << " pairs with unknown words\n";
+	}
+	out.flush();
+}
+
+/**
+* @Function: evaluates a snapshot of the word vectors every few tokens on a background thread at idle
+* priority, without sets the score is the negated training loss, a plateau is patience evaluations in
+* a row that do not beat the best score by minDelta.
+*/
+class Monitor {
+  protected:
+	std::shared_ptr<Evaluator> evaluator_;
+	std::thread worker_;
+	std::atomic<bool> busy_;
+	std::atomic<bool> plateau_;
+	int64_t every_;
+	int64_t next_;
+	int32_t patience_;
+	double minDelta_;
+	double best_;
+	int32_t stale_;
+	int32_t threads_;
+
+	void record(double);
+
+  public:
+	Monitor(std::shared_ptr<Evaluator>, int64_t, int64_t, int32_t, double, int32_t);
+	~Monitor();
+
+	inline bool plateau() const {
+		return plateau_.load();
+	}
+	bool due(int64_t) const;
+	bool start(int64_t, real, real, std::function<std::shared_ptr<NearestNeighbors>()>);
+	void wait();
+};
+
+/**
+* @Function: initial Monitor class argument, an evaluation every every tokens from the token count start.
+*/
+Monitor::Monitor(std::shared_ptr<Evaluator> evaluator, int64_t every, int64_t start, int32_t patience,
+		double minDelta, int32_t threads) : evaluator_(evaluator), busy_(false), plateau_(false), every_(every),
+	next_(start + every), patience_(patience), minDelta_(minDelta), best_(-HUGE_VAL), stale_(0),
+	threads_(std::max(threads, 1)) {}
+
+Monitor::~Monitor() {
+	wait();
+}
+
+/**
+* @Function: whether the next evaluation is reached and the previous one is done, never after a plateau.
+*/
+bool Monitor::due(int64_t tokens) const {
+	return !plateau_.load() && !busy_.load() && tokens >= next_;
+}
+
+/**
+* @Function: keep the best score and count the evaluations since it was reached.
+*/
+void Monitor::record(double score) {
+	if (score > best_ + minDelta_) {
+		best_ = score;
+		stale_ = 0;
+	} else {
+		stale_++;
+	}
+	if (patience_ > 0 && stale_ >= patience_) {
+		plateau_ = true;
+	}
+}
+
+/**
+* @Function: evaluate on the background thread unless the previous evaluation is still running,
+* snapshot copies the word vectors there so the training threads never wait for it.
+*/
+bool Monitor::start(int64_t tokens, real progress, real loss, std::function<std::shared_ptr<NearestNeighbors>()> snapshot) {
+	if (busy_.load()) {
+		return false;
+	}
+	if (worker_.joinable()) {
+		worker_.join();
+	}
+	next_ = tokens + every_;
+	busy_ = true;
+	auto run = [this, tokens, progress, loss, snapshot]() {
+		try {
+			std::ostringstream out;
+			out << std::fixed << std::setprecision(1) << "\nEvaluation at " << 100.0 * progress << "% (" << tokens
+				<< " tokens) loss: " << std::setprecision(6) << loss << "\n";
+			double score = -loss;
+			if (!evaluator_->empty()) {
+				std::shared_ptr<NearestNeighbors> nn = snapshot();
+				evaluation::Report report = evaluator_->evaluate(*nn, threads_);
+				Evaluator::print(report, out);
+				score = evaluator_->hasAnalogy() ? report.accuracy() : report.spearman;
+			}
+			record(score);
+			if (patience_ > 0) {
+				out << "no improvement in " << stale_ << " of " << patience_ << " evaluations\n";
+			}
+			std::cerr << out.str() << std::flush;
+		} catch (const std::exception& e) {
+			std::cerr << "\nevaluation failed: " << e.what() << std::endl;
+		}
+		busy_ = false;
+	};
+	if (evaluator_->empty()) {
+		// the loss alone costs nothing to score
+		run();
+		return true;
+	}
+	worker_ = std::thread([run]() {
+		// idle priority, the threads of the evaluation inherit it and only take cpu left by the training
+		sched_param param;
+		param.sched_priority = 0;
+		pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+		run();
+	});
+	return true;
+}
+
+/**
+* @Function: wait for the evaluation being run.
+*/
+void Monitor::wait() {
+	if (worker_.joinable()) {
+		worker_.join();
+	}
+}
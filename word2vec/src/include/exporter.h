@@ -0,0 +1,163 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: exporter.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: parallel text export of matrix rows, formatted on all threads and written in order.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <stdexcept>
+#include <algorithm>
+
+#include "matrix.h"
+#include "real.h"
+
+namespace exporter {
+
+// rows formatted by one task, a few MB of text at dim 300
+static const int64_t CHUNK_ROWS = 2048;
+
+/**
+* @Function: append a float, precision 0 is the shortest text that reads back to the same float.
+*/
+inline void append(std::string& out, real v, int32_t precision) {
+	char buf[32];
+	int n;
+	if (precision > 0) {
+		n = std::snprintf(buf, sizeof(buf), "%.*g", precision, double(v));
+	} else {
+		// most trained values need 7 or 8 digits and 9 always read back, fewer digits are tried
+		// only while they still read back, %g drops the trailing zeros of the short ones
+		n = std::snprintf(buf, sizeof(buf), "%.8g", double(v));
+		if (std::strtof(buf, nullptr) != v) {
+			n = std::snprintf(buf, sizeof(buf), "%.9g", double(v));
+		} else {
+			char shorter[32];
+			for (int32_t p = 7; p >= 6; p--) {
+				int m = std::snprintf(shorter, sizeof(shorter), "%.*g", p, double(v));
+				if (std::strtof(shorter, nullptr) != v) {
+					break;
+				}
+				std::memcpy(buf, shorter, m + 1);
+				n = m;
+			}
+		}
+	}
+	out.append(buf, n);
+}
+
+/**
+* @Function: text of rows [begin, end) of a matrix, each line is the name and the values.
+*/
+void format(std::string& out, const Matrix& m, int64_t first, int64_t begin, int64_t end,
+		const std::function<std::string(int64_t)>& name, int32_t precision) {
+	out.clear();
+	for (int64_t i = begin; i < end; i++) {
+		out += name(i);
+		out += ' ';
+		const real* row = m.row(first + i);
+		for (int64_t j = 0; j < m.cols(); j++) {
+			append(out, row[j], precision);
+			out += ' ';
+		}
+		out += '\n';
+	}
+}
+
+/**
+* @Function: write rows [begin, end) to one file, threads format chunks ahead of the writer.
+*/
+void writeFile(const std::string& path, const Matrix& m, int64_t first, int64_t begin, int64_t end,
+		const std::function<std::string(int64_t)>& name, int32_t threads, int32_t precision) {
+	FILE* f = std::fopen(path.c_str(), "wb");
+	if (f == nullptr) {
+		throw std::invalid_argument(path + " cannot be opened for saving embedding.");
+	}
+	const int64_t nchunks = (end - begin + CHUNK_ROWS - 1) / CHUNK_ROWS;
+	// chunks formatted but not written yet are bounded by the window
+	const int64_t window = 2 * int64_t(threads);
+	std::vector<std::string> ring(window);
+	std::vector<char> ready(window, 0);
+	std::mutex mutex;
+	std::condition_variable cv;
+	int64_t next = 0;
+	int64_t written = 0;
+
+	auto worker = [&]() {
+		std::string buf;
+		while (true) {
+			int64_t c;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cv.wait(lock, [&]() { return next >= nchunks || next < written + window; });
+				if (next >= nchunks) {
+					return;
+				}
+				c = next++;
+			}
+			int64_t b = begin + c * CHUNK_ROWS;
+			format(buf, m, first, b, std::min(end, b + CHUNK_ROWS), name, precision);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				ring[c % window].swap(buf);
+				ready[c % window] = 1;
+			}
+			cv.notify_all();
+		}
+	};
+	std::vector<std::thread> workers;
+	for (int32_t t = 0; t < threads; t++) {
+		workers.push_back(std::thread(worker));
+	}
+	bool failed = false;
+	std::string buf;
+	for (int64_t c = 0; c < nchunks; c++) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [&]() { return ready[c % window] != 0; });
+			buf.swap(ring[c % window]);
+			ready[c % window] = 0;
+			written = c + 1;
+		}
+		cv.notify_all();
+		if (std::fwrite(buf.data(), 1, buf.size(), f) != buf.size()) {
+			failed = true;
+		}
+	}
+	for (size_t t = 0; t < workers.size(); t++) {
+		workers[t].join();
+	}
+	if (std::fclose(f) != 0 || failed) {
+		throw std::invalid_argument(path + " could not be written.");
+	}
+}
+
+/**
+* @Function: export n rows starting at row first, split into shards files path.0, path.1, ... when shards > 1.
+*/
+void exportText(const std::string& path, const Matrix& m, int64_t first, int64_t n,
+		const std::function<std::string(int64_t)>& name, int32_t threads, int32_t precision, int32_t shards) {
+	threads = std::max(threads, 1);
+	if (shards <= 1) {
+		writeFile(path, m, first, 0, n, name, threads, precision);
+		return;
+	}
+	for (int32_t s = 0; s < shards; s++) {
+		writeFile(path + "." + std::to_string(s), m, first, n * s / shards, n * (s + 1) / shards,
+			name, threads, precision);
+	}
+}
+
+}
@@ -9,8 +9,6 @@
 
 #pragma once
 
-#include<time.h>
-
 #include<iostream>
 #include<vector>
 #include<string>
@@ -23,7 +21,18 @@
 #include "dictionary.h"
 #include "matrix.h"
 #include "model.h"
+#include "binmodel.h"
+#include "exporter.h"
+#include "pretrained.h"
+#include "checkpoint.h"
+#include "wordvectors.h"
+#include "evaluation.h"
+#include "policy.h"
 #include "real.h"
+#include "telemetry.h"
+#include "profiler.h"
+#include "perfcounters.h"
+#include "memreport.h"
 #include "utils.h"
 
 class FastText {
@@ -39,23 +48,49 @@ class FastText {
 	std::atomic<int64_t> tokenCount_;
 	std::atomic<real> loss_;
 
-	clock_t start_;
-
+	std::shared_ptr<Telemetry> telemetry_;
+	std::shared_ptr<Profiler> profiler_;
+	std::shared_ptr<PerfReport> perf_;
+	std::shared_ptr<MemReport> memreport_;
+	std::shared_ptr<Checkpointer> checkpointer_;
+	// -live, the matrices are trained in a shared memory segment readable by other processes
+	std::shared_ptr<binmodel::Segment> live_;
+	// -evalEvery, periodic evaluation of the word vectors, and the early stop it raises
+	std::shared_ptr<Monitor> monitor_;
+	std::atomic<bool> stop_;
+
+	// progress restored by resume, and the per-thread state saved by the checkpoints
+	checkpoint::Progress start_;
+	std::unique_ptr<std::atomic<int64_t>[]> positions_;
+	std::unique_ptr<std::atomic<int64_t>[]> threadTokens_;
+
+	// deterministic mode, the threads train their lines in turn
+	std::atomic<int32_t> turn_;
+	std::vector<char> finished_;
+
+	void allocate();
+	std::shared_ptr<NearestNeighbors> snapshot() const;
 	void startThreads();
+	void trainModel();
+	void saveCheckpoint();
+	checkpoint::Progress progress() const;
+	void waitTurn(int32_t);
+	void passTurn(int32_t);
 
   public:
 	FastText();
 	void saveVectors();
 	void printInfo(real, real, std::ostream&);
 
-	void skipgram(Model&, real, const std::vector<std::vector<int32_t> >&, const std::vector<int32_t>&);
-	void cbow(Model&, real, const std::vector<std::vector<int32_t> >&, const std::vector<int32_t>&);
-	void subword(Model&, real, const std::vector<std::vector<int32_t> >&, const std::vector<int32_t>&);
-	void subchar_chinese(Model&, real, const std::vector<std::vector<int32_t> >&, const std::vector<int32_t>&);
-	void subradical(Model&, real, const std::vector<std::vector<int32_t> >&, const std::vector<int32_t>&);
-	void subcomponent(Model&, real, const std::vector<std::vector<int32_t> >&, const std::vector<int32_t>&);
+	template <class Input, class Update, int32_t DIM>
+	void trainLoop(int32_t);
+	template <class Input, class Update>
+	void trainDim(int32_t);
 	void trainThread(int32_t);
 	void train(const Args);
+	void resume(const std::vector<std::string>&);
+	void update(const std::vector<std::string>&);
+	std::shared_ptr<WordVectors> getWordVectors(size_t) const;
 };
 
 FastText::FastText() {}
@@ -63,6 +98,10 @@ FastText::FastText() {}
 void FastText::train(const Args args) {
 	args_ = std::make_shared<Args>(args);
 	dict_ = std::make_shared<Dictionary>(args_);
+	telemetry_ = std::make_shared<Telemetry>(args_);
+	if (args_->memreport) {
+		memreport_ = std::make_shared<MemReport>();
+	}
 	if (args_->input == "-") {
 		//manage expectations
 		throw std::invalid_argument("Cannot use stdin for training");
@@ -73,6 +112,7 @@ void FastText::train(const Args args) {
 		throw std::invalid_argument(args_->input + "cannot be opened for training!");
 	}
 	std::cout << "Training From " << args_->input << std::endl;
+	int64_t phaseStart = telemetry::now();
 
 	if ((args_->model == model_name::skipgram) || (args_->model == model_name::cbow) || (args_->model == model_name::subword) 
 		|| (args_->model == model_name::subchar_chinese)) {
@@ -102,261 +142,595 @@ void FastText::train(const Args args) {
 		ifs.close();
 		infeature.close();
 	}
-	
+	telemetry_->phase("dictionary", (telemetry::now() - phaseStart) / 1e9);
+	if (memreport_) {
+		dict_->memoryReport(*memreport_);
+		memreport_->phase("dictionary");
+	}
 
-	input_ = std::make_shared<Matrix>(dict_->nwords() + dict_->nfeatures(), args_->dim);
+	phaseStart = telemetry::now();
+	allocate();
 	//input_ = std::make_shared<Matrix>(dict_->nwords() + args_->bucket, args_->dim);
-	input_->uniform(1.0 / args_->dim);
+	input_->uniform(1.0 / args_->dim, args_->thread, args_->seed);
+	if (args_->pretrainedVectors != "") {
+		// rows missing from the pretrained files keep their random initialization
+		int64_t loaded = pretrained::load(args_->pretrainedVectors, *dict_, *input_, args_->thread);
+		std::cout << "Loaded " << loaded << " of " << input_->rows() << " rows from " << args_->pretrainedVectors << std::endl;
+	}
 
-	output_ = std::make_shared<Matrix>(dict_->nwords(), args_->dim);
-	output_->zero();
+	output_->zero(args_->thread);
+	telemetry_->phase("init", (telemetry::now() - phaseStart) / 1e9);
+	if (memreport_) {
+		memreport_->add("input_", input_->memoryUsage());
+		memreport_->add("output_", output_->memoryUsage());
+		memreport_->phase("init");
+	}
+
+	trainModel();
+}
+
+/**
+* @Function: train from the state restored or initialized by train and resume.
+*/
+void FastText::trainModel() {
+	int64_t phaseStart = telemetry::now();
 	startThreads();
+	telemetry_->phase("train", (telemetry::now() - phaseStart) / 1e9);
 	model_ = std::make_shared<Model>(input_, output_, args_, 0);
 	model_->setTargetCounts(dict_->getCounts());
+	if (memreport_) {
+		model_->memoryReport(*memreport_, "model");
+		memreport_->phase("train");
+	}
 }
 
-
-void FastText::printInfo(real progress, real loss, std::ostream& log_stream) {
-	// clock_t might also only be 32bits wide on some systems
-	double t = double(clock() - start_) / double(CLOCKS_PER_SEC);
-	double lr = args_->lr * (1.0 - progress);
-	double wst = 0;
-	int64_t eta = 720 * 3600; // Default to one month
-	if (progress > 0 && t >= 0) {
-		eta = int(t / progress * (1 - progress) / args_->thread);
-		wst = double(tokenCount_) / t;
+/**
+* @Function: restore args, dictionary, matrices and progress from -checkpoint and continue training,
+* the other arguments given override the saved ones.
+*/
+void FastText::resume(const std::vector<std::string>& argv) {
+	Args a;
+	a.parseArgs(argv);
+	if (a.checkpoint == "") {
+		throw std::invalid_argument("resume needs the checkpoint file [-checkpoint]");
 	}
-	int64_t etam = (eta % 3600) / 60;
-	int64_t etah = etam / 60;
-	progress = progress * 100;
-	log_stream << std::fixed;
-	log_stream << "Progress: ";
-	log_stream << std::setprecision(1) << std::setw(5) << progress << "%";
-	log_stream << " words/sec/thread: " << std::setw(7) << int64_t(wst);
-	log_stream << " lr: " << std::setw(9) << std::setprecision(6) << lr;
-	log_stream << " loss: " << std::setw(9) << std::setprecision(6) << loss;
-	log_stream << " ETA: " << std::setw(3) << etah;
-	log_stream << "h" << std::setw(2) << etam << "m";
-	log_stream << std::flush;
+	std::ifstream in;
+	int64_t generation = 0;
+	checkpoint::open(a.checkpoint, in, generation);
+	std::cout << "Resume From " << a.checkpoint << std::endl;
+	int64_t phaseStart = telemetry::now();
+	Args saved;
+	saved.load(in);
+	saved.parseArgs(argv);
+	args_ = std::make_shared<Args>(saved);
+	telemetry_ = std::make_shared<Telemetry>(args_);
+	if (args_->memreport) {
+		memreport_ = std::make_shared<MemReport>();
+	}
+	dict_ = std::make_shared<Dictionary>(args_);
+	dict_->load(in);
+	checkpoint::loadProgress(in, start_);
+	input_ = Matrix::read(in);
+	output_ = input_ ? Matrix::read(in) : nullptr;
+	if (!in || !input_ || !output_) {
+		throw std::invalid_argument(a.checkpoint + " is truncated.");
+	}
+	in.close();
+	int32_t deltas = checkpoint::loadDeltas(a.checkpoint, generation, *input_, *output_, start_);
+	if (deltas > 0) {
+		std::cout << "Applied " << deltas << " checkpoint deltas" << std::endl;
+	}
+	if (input_->cols() != args_->dim || input_->rows() != dict_->nwords() + dict_->nfeatures()) {
+		throw std::invalid_argument(a.checkpoint + " matrices do not match its dictionary.");
+	}
+	if (args_->live != "") {
+		// the restored rows move into the shared memory segment
+		std::shared_ptr<Matrix> input = input_;
+		std::shared_ptr<Matrix> output = output_;
+		allocate();
+		std::memcpy(input_->data(), input->data(), input->rows() * input->cols() * sizeof(real));
+		std::memcpy(output_->data(), output->data(), output->rows() * output->cols() * sizeof(real));
+	}
+	telemetry_->phase("resume", (telemetry::now() - phaseStart) / 1e9);
+	if (memreport_) {
+		dict_->memoryReport(*memreport_);
+		memreport_->add("input_", input_->memoryUsage());
+		memreport_->add("output_", output_->memoryUsage());
+		memreport_->phase("resume");
+	}
+	std::cout << "Progress " << start_.tokenCount << " of " << int64_t(args_->epoch) * dict_->ntrainTokens() << " tokens" << std::endl;
+	trainModel();
 }
 
-void FastText::skipgram(Model& model, real lr, const std::vector<std::vector<int32_t> >& source,
-	const std::vector<int32_t>& target) {
-	std::uniform_int_distribution<> uniform(1, args_->ws);
-	for (int32_t w = 0; w < target.size(); w++) {
-		int32_t boundary = uniform(model.rng);
-		const std::vector<int32_t>& ngrams = source[w];
-		//std::cout << ngrams[0] << std::endl;
-		assert(ngrams.size() == 1);
-		for (int32_t c = -boundary; c <= boundary; c++) {
-			if (c != 0 && w + c >= 0 && w + c < target.size()) {
-				model.update(ngrams, target[w + c], lr);
-			}
-		}
+/**
+* @Function: continue the model of -previous on the new corpus of -input, the known words and features
+* keep their rows and the new ones are appended, the other arguments given override the saved ones.
+*/
+void FastText::update(const std::vector<std::string>& argv) {
+	Args a;
+	a.parseArgs(argv);
+	if (a.previous == "") {
+		throw std::invalid_argument("update needs the checkpoint of the previous model [-previous]");
+	}
+	std::ifstream in;
+	int64_t generation = 0;
+	checkpoint::open(a.previous, in, generation);
+	std::cout << "Update " << a.previous << std::endl;
+	int64_t phaseStart = telemetry::now();
+	Args saved;
+	saved.load(in);
+	saved.parseArgs(argv);
+	args_ = std::make_shared<Args>(saved);
+	telemetry_ = std::make_shared<Telemetry>(args_);
+	if (args_->memreport) {
+		memreport_ = std::make_shared<MemReport>();
+	}
+	dict_ = std::make_shared<Dictionary>(args_);
+	dict_->load(in);
+	checkpoint::Progress previous;
+	checkpoint::loadProgress(in, previous);
+	std::shared_ptr<Matrix> savedInput = Matrix::read(in);
+	std::shared_ptr<Matrix> savedOutput = savedInput ? Matrix::read(in) : nullptr;
+	if (!in || !savedInput || !savedOutput) {
+		throw std::invalid_argument(a.previous + " is truncated.");
+	}
+	in.close();
+	const Matrix& input = *savedInput;
+	const Matrix& output = *savedOutput;
+	checkpoint::loadDeltas(a.previous, generation, *savedInput, *savedOutput, previous);
+	const int64_t nwords = dict_->nwords();
+	const int64_t nfeatures = dict_->nfeatures();
+	if (input.cols() != args_->dim || input.rows() != nwords + nfeatures) {
+		throw std::invalid_argument(a.previous + " matrices do not match its dictionary.");
 	}
-}
 
-void FastText::cbow(Model& model, real lr, const std::vector<std::vector<int32_t> >& source,
-	const std::vector<int32_t>& target) {
-	std::vector<int32_t> bow;
-	std::uniform_int_distribution<> uniform(1, args_->ws);
-	for (int32_t w = 0; w < target.size(); w++) {
-		int32_t boundary = uniform(model.rng);
-		bow.clear();
-		for (int32_t c = -boundary; c <= boundary; c++) {
-			if (c != 0 && w + c >= 0 && w + c < target.size()) {
-				const std::vector<int32_t>& ngrams = source[w];
-				bow.insert(bow.end(), ngrams.cbegin(), ngrams.cend());
-			}
-		}
-		model.update(bow, target[w], lr);
+	std::ifstream ifs(args_->input);
+	if (!ifs.is_open()) {
+		throw std::invalid_argument(args_->input + " cannot be opened for training!");
+	}
+	const std::string featureFile = args_->model == model_name::subradical ? args_->inradical
+		: (args_->model == model_name::subcomponent ? args_->incomponent : "");
+	std::ifstream infeature(featureFile);
+	if (infeature.is_open()) {
+		dict_->update(ifs, infeature);
+	} else {
+		dict_->update(ifs);
+	}
+	ifs.close();
+	telemetry_->phase("dictionary", (telemetry::now() - phaseStart) / 1e9);
+	if (memreport_) {
+		dict_->memoryReport(*memreport_);
+		memreport_->phase("dictionary");
 	}
+
+	// the new rows are initialized as in train, the known rows are copied, features move past the new words
+	phaseStart = telemetry::now();
+	const int64_t dim = args_->dim;
+	allocate();
+	input_->uniform(1.0 / dim, args_->thread, args_->seed);
+	output_->zero(args_->thread);
+	const int64_t shift = dict_->nwords() - nwords;
+	utils::parallel(args_->thread, [&](int32_t t) {
+		const int32_t n = args_->thread;
+		std::memcpy(input_->row(nwords * t / n), input.row(nwords * t / n),
+			(nwords * (t + 1) / n - nwords * t / n) * dim * sizeof(real));
+		std::memcpy(input_->row(nwords + shift + nfeatures * t / n), input.row(nwords + nfeatures * t / n),
+			(nfeatures * (t + 1) / n - nfeatures * t / n) * dim * sizeof(real));
+		std::memcpy(output_->row(nwords * t / n), output.row(nwords * t / n),
+			(nwords * (t + 1) / n - nwords * t / n) * dim * sizeof(real));
+	});
+	telemetry_->phase("init", (telemetry::now() - phaseStart) / 1e9);
+	if (memreport_) {
+		memreport_->add("input_", input_->memoryUsage());
+		memreport_->add("output_", output_->memoryUsage());
+		memreport_->phase("init");
+	}
+	std::cout << "Words " << nwords << " -> " << dict_->nwords() << ", features " << nfeatures
+		<< " -> " << dict_->nfeatures() << std::endl;
+	trainModel();
 }
 
-void FastText::subword(Model& model, real lr, const std::vector<std::vector<int32_t> >& source, const std::vector<int32_t>& target) {
-	std::uniform_int_distribution<> uniform(1, args_->ws);
-	for (int32_t w = 0; w < target.size(); w++) {
-		int32_t boundary = uniform(model.rng);
-		const std::vector<int32_t>& ngrams = source[w];
-		for (int32_t c = -boundary; c <= boundary; c++) {
-			if (c != 0 && w + c >= 0 && w + c < target.size()) {
-				model.update(ngrams, target[w + c], lr);
-			}
-		}
+/**
+* @Function: input_ and output_ for the rows of the dictionary, in the shared memory segment of -live if given.
+*/
+void FastText::allocate() {
+	const int64_t rows = dict_->nwords() + dict_->nfeatures();
+	if (args_->live == "") {
+		input_ = std::make_shared<Matrix>(rows, args_->dim);
+		output_ = std::make_shared<Matrix>(dict_->nwords(), args_->dim);
+		return;
 	}
+	live_ = std::make_shared<binmodel::Segment>(args_->live, *args_, *dict_, dict_->nwords());
+	// the matrices share the ownership of the segment
+	input_ = std::make_shared<Matrix>(std::shared_ptr<real>(live_, live_->input), rows, args_->dim);
+	output_ = std::make_shared<Matrix>(std::shared_ptr<real>(live_, live_->output), dict_->nwords(), args_->dim);
+	std::cout << "Live model in shared memory " << binmodel::shmName(args_->live) << std::endl;
 }
 
-void FastText::subchar_chinese(Model& model, real lr, const std::vector<std::vector<int32_t> >& source, const std::vector<int32_t>& target) {
-	std::uniform_int_distribution<> uniform(1, args_->ws);
-	for (int32_t w = 0; w < target.size(); w++) {
-		int32_t boundary = uniform(model.rng);
-		const std::vector<int32_t>& ngrams = source[w];
-		for (int32_t c = -boundary; c <= boundary; c++) {
-			if (c != 0 && w + c >= 0 && w + c < target.size()) {
-				model.update(ngrams, target[w + c], lr);
-			}
-		}
+/**
+* @Function: a copy of the word rows of input_ taken while training goes on, normalized for evaluation.
+*/
+std::shared_ptr<NearestNeighbors> FastText::snapshot() const {
+	const int64_t nwords = dict_->nwords();
+	std::shared_ptr<Matrix> words = std::make_shared<Matrix>(nwords, args_->dim);
+	std::memcpy(words->data(), input_->data(), nwords * args_->dim * sizeof(real));
+	std::vector<std::string> names(nwords);
+	for (int64_t i = 0; i < nwords; i++) {
+		names[i] = dict_->getWord(i);
 	}
+	return std::make_shared<NearestNeighbors>(words, names, args_->thread);
 }
 
+/**
+* @Function: vectors of any word from the trained model, unseen words composed from their features.
+*/
+std::shared_ptr<WordVectors> FastText::getWordVectors(size_t cacheSize) const {
+	return std::make_shared<WordVectors>(dict_, input_, cacheSize);
+}
 
-void FastText::subradical(Model& model, real lr, const std::vector<std::vector<int32_t> >& source, const std::vector<int32_t>& target) {
-	std::uniform_int_distribution<> uniform(1, args_->ws);
-	for (int32_t w = 0; w < target.size(); w++) {
-		int32_t boundary = uniform(model.rng);
-		const std::vector<int32_t>& ngrams = source[w];
-		for (int32_t c = -boundary; c <= boundary; c++) {
-			if (c != 0 && w + c >= 0 && w + c < target.size()) {
-				//model.update(ngrams, target[w + c], lr);
-				model.updatePara(ngrams, target[w + c], lr);
-			}
-		}
+/**
+* @Function: the progress of the training threads.
+*/
+checkpoint::Progress FastText::progress() const {
+	checkpoint::Progress progress;
+	progress.tokenCount = tokenCount_;
+	for (int32_t i = 0; i < args_->thread; i++) {
+		progress.positions.push_back(positions_[i]);
+		progress.threadTokens.push_back(threadTokens_[i]);
 	}
+	return progress;
 }
 
-void FastText::subcomponent(Model& model, real lr, const std::vector<std::vector<int32_t> >& source, const std::vector<int32_t>& target) {
-	std::uniform_int_distribution<> uniform(1, args_->ws);
-	for (int32_t w = 0; w < target.size(); w++) {
-		int32_t boundary = uniform(model.rng);
-		const std::vector<int32_t>& ngrams = source[w];
-		for (int32_t c = -boundary; c <= boundary; c++) {
-			if (c != 0 && w + c >= 0 && w + c < target.size()) {
-				//model.update(ngrams, target[w + c], lr);
-				model.updatePara(ngrams, target[w + c], lr);
-			}
+/**
+* @Function: start a checkpoint of the current progress, the matrices are copied while training goes on.
+*/
+void FastText::saveCheckpoint() {
+	checkpoint::Progress progress = this->progress();
+	checkpointer_->start(telemetry::now(), [this, progress](const checkpoint::Chain& chain) {
+		int64_t start = telemetry::now();
+		if (chain.sequence == 0) {
+			checkpoint::save(args_->checkpoint, *args_, *dict_, *input_, *output_, progress, chain);
+		} else {
+			checkpoint::saveDelta(args_->checkpoint, *input_, *output_, progress, chain);
 		}
+		if (args_->verbose > 1) {
+			std::cerr << "\rCheckpoint " << (chain.sequence == 0 ? args_->checkpoint : checkpoint::deltaPath(args_->checkpoint, chain.sequence))
+				<< " written in " << std::fixed << std::setprecision(2) << (telemetry::now() - start) / 1e9 << "s" << std::endl;
+		}
+	});
+}
+
+void FastText::printInfo(real progress, real loss, std::ostream& log_stream) {
+	// wall clock, clock() would sum the cpu time of all threads
+	double t = telemetry_->elapsed();
+	double lr = args_->lr * (1.0 - progress);
+	double wst = 0;
+	int64_t eta = 720 * 3600; // Default to one month
+	// a resumed run is timed from the progress it resumed at
+	const int64_t ntokens = int64_t(args_->epoch) * dict_->ntrainTokens();
+	double done = progress - double(start_.tokenCount) / ntokens;
+	if (done > 0 && t > 0) {
+		eta = int64_t(t / done * (1 - progress));
+		wst = double(tokenCount_ - start_.tokenCount) / t / args_->thread;
 	}
+	int64_t etam = (eta % 3600) / 60;
+	int64_t etah = eta / 3600;
+	progress = progress * 100;
+	log_stream << std::fixed;
+	log_stream << "Progress: ";
+	log_stream << std::setprecision(1) << std::setw(5) << progress << "%";
+	log_stream << " words/sec/thread: " << std::setw(7) << int64_t(wst);
+	log_stream << " lr: " << std::setw(9) << std::setprecision(6) << lr;
+	log_stream << " loss: " << std::setw(9) << std::setprecision(6) << loss;
+	log_stream << " ETA: " << std::setw(3) << etah;
+	log_stream << "h" << std::setw(2) << etam << "m";
+	if (perf_) {
+		// the counters only cover this process, not the tokens trained before a resume
+		perf_->print(tokenCount_ - start_.tokenCount, log_stream);
+	}
+	log_stream << std::flush;
 }
 
-void FastText::trainThread(int32_t threadId) {
+/**
+* @Function: the training loop of one thread, one instantiation per model and specialized dim.
+*/
+template <class Input, class Update, int32_t DIM>
+void FastText::trainLoop(int32_t threadId) {
 	std::ifstream ifs(args_->input);
-	utils::seek(ifs, threadId * utils::size(ifs) / args_->thread);
+	// a resumed thread continues from its saved position when the thread count is unchanged
+	const bool restored = int32_t(start_.positions.size()) == args_->thread;
+	utils::seek(ifs, restored ? start_.positions[threadId] : threadId * utils::size(ifs) / args_->thread);
+	if (checkpointer_)
+		positions_[threadId] = ifs.tellg();
 
-	Model model(input_, output_, args_, threadId);
+	Model model(input_, output_, args_, rng::threadSeed(args_->seed, threadId));
 	model.setTargetCounts(dict_->getCounts());
+	if (memreport_)
+		model.memoryReport(*memreport_, "model[" + std::to_string(threadId) + "]");
+
+	std::unique_ptr<PerfCounters> counters;
+	if (perf_) {
+		counters.reset(new PerfCounters(args_->perfRaw));
+	}
 
-	const int64_t ntokens = dict_->ntokens();
+	Input input;
+	const int64_t ntokens = args_->epoch * dict_->ntrainTokens();
+	// deterministic mode, each thread trains its own share of the tokens
+	const bool deterministic = args_->deterministic;
+	const int64_t share = (ntokens + args_->thread - 1) / args_->thread;
+	int64_t threadTokenCount = restored ? start_.threadTokens[threadId] : start_.tokenCount / args_->thread;
 	int64_t localTokenCount = 0;
 	std::vector<std::vector<int32_t> > sourceType;
 	std::vector<std::vector<int32_t> > source;
 	std::vector<int32_t> target;
-	while (tokenCount_ < args_->epoch * ntokens) {
-		real process = real(tokenCount_) / (args_->epoch * ntokens);
+	while (!stop_ && (deterministic ? threadTokenCount < share : tokenCount_ < ntokens)) {
+		real process = deterministic ? real(threadTokenCount) / share : real(tokenCount_) / ntokens;
 		real lr = args_->lr * (1.0 - process);
 		if (lr < 0.0001 * args_->lr)
 			lr = 0.0001 * args_->lr;
-		if (args_->model == model_name::skipgram) {
-			localTokenCount += dict_->getLine(ifs, sourceType, source, target, model.rng);
-			skipgram(model, lr, source, target);
-		} else if (args_->model == model_name::cbow) {
-			localTokenCount += dict_->getLine(ifs, sourceType, source, target, model.rng);
-			cbow(model, lr, source, target);
-		} else if (args_->model == model_name::subword) {
-			localTokenCount += dict_->getLine(ifs, sourceType, source, target, model.rng);
-			subword(model, lr, source, target);
-		} else if (args_->model == model_name::subchar_chinese) {
-			exit(0);
-			localTokenCount += dict_->getLine_zh(ifs, sourceType, source, target, model.rng);
-			subchar_chinese(model, lr, source, target);
-		} else if (args_->model == model_name::subradical){
-			localTokenCount += dict_->getLine(ifs, sourceType, source, target, model.rng);
-			subradical(model, lr, source, target);
-		} else if (args_->model == model_name::subcomponent) {
-			localTokenCount += dict_->getLine(ifs, sourceType, source, target, model.rng);
-			subcomponent(model, lr, source, target);
+		if (profiler_)
+			profiler_->beginLine(threadId);
+		int64_t lineStart = telemetry::now();
+		int32_t lineTokenCount = input.getLine(*dict_, ifs, sourceType, source, target, model.rng);
+		int64_t lineRead = telemetry::now();
+		localTokenCount += lineTokenCount;
+		threadTokenCount += lineTokenCount;
+		if (deterministic) {
+			waitTurn(threadId);
+			input.template train<Update, DIM>(model, lr, args_->ws, source, target);
+			model.flush();
+			if (threadTokenCount >= share)
+				finished_[threadId] = 1;
+			passTurn(threadId);
+		} else {
+			input.template train<Update, DIM>(model, lr, args_->ws, source, target);
+			model.flush();
 		}
+		if (profiler_)
+			profiler_->endLine();
+		telemetry_->addIO(threadId, lineRead - lineStart);
+		telemetry_->addCompute(threadId, telemetry::now() - lineRead);
 		if (localTokenCount > args_->lrUpdateRate) {
 			tokenCount_ += localTokenCount;
+			telemetry_->addTokens(threadId, localTokenCount);
+			telemetry_->setLoss(threadId, model.getLoss());
 			localTokenCount = 0;
-			if (threadId == 0 && args_->verbose > 1)
-				loss_ = model.getLoss();
+			if (counters && counters->due())
+				perf_->store(threadId, *counters);
+			if (checkpointer_) {
+				int64_t pos = ifs.tellg();
+				if (pos >= 0)
+					positions_[threadId] = pos;
+				threadTokens_[threadId] = threadTokenCount;
+			}
 		}
 	}
-	if (threadId == 0)
-		loss_ = model.getLoss();
+	if (deterministic && !finished_[threadId]) {
+		// stopped early, leave the turns to the threads still training
+		waitTurn(threadId);
+		finished_[threadId] = 1;
+		passTurn(threadId);
+	}
+	if (counters)
+		perf_->store(threadId, *counters);
+	tokenCount_ += localTokenCount;
+	telemetry_->addTokens(threadId, localTokenCount);
+	telemetry_->setLoss(threadId, model.getLoss());
 	ifs.close();
 }
 
+/**
+* @Function: deterministic mode, wait until this thread holds the turn.
+*/
+void FastText::waitTurn(int32_t threadId) {
+	while (turn_.load(std::memory_order_acquire) != threadId) {
+		std::this_thread::yield();
+	}
+}
+
+/**
+* @Function: deterministic mode, hand the turn to the next unfinished thread.
+*/
+void FastText::passTurn(int32_t threadId) {
+	int32_t next = threadId;
+	for (int32_t i = 0; i < args_->thread; i++) {
+		next = (next + 1) % args_->thread;
+		if (!finished_[next])
+			break;
+	}
+	turn_.store(next, std::memory_order_release);
+}
+
+/**
+* @Function: dispatch the dim once per thread, the loop then calls its update kernel directly.
+*/
+template <class Input, class Update>
+void FastText::trainDim(int32_t threadId) {
+	switch (Model::specializedDim(*args_)) {
+	case 50:
+		trainLoop<Input, Update, 50>(threadId);
+		break;
+	case 100:
+		trainLoop<Input, Update, 100>(threadId);
+		break;
+	case 128:
+		trainLoop<Input, Update, 128>(threadId);
+		break;
+	case 200:
+		trainLoop<Input, Update, 200>(threadId);
+		break;
+	case 256:
+		trainLoop<Input, Update, 256>(threadId);
+		break;
+	case 300:
+		trainLoop<Input, Update, 300>(threadId);
+		break;
+	default:
+		trainLoop<Input, Update, 0>(threadId);
+	}
+}
+
+/**
+* @Function: dispatch the model once per thread.
+*/
+void FastText::trainThread(int32_t threadId) {
+	switch (args_->model) {
+	case model_name::skipgram:
+	case model_name::subword:
+		trainDim<policy::ContextInput<policy::WordLine>, policy::JointUpdate>(threadId);
+		break;
+	case model_name::cbow:
+		trainDim<policy::BagInput<policy::WordLine>, policy::JointUpdate>(threadId);
+		break;
+	case model_name::subchar_chinese:
+		exit(0);
+		trainDim<policy::ContextInput<policy::RadicalLine>, policy::JointUpdate>(threadId);
+		break;
+	case model_name::subradical:
+	case model_name::subcomponent:
+		trainDim<policy::ContextInput<policy::WordLine>, policy::SplitUpdate>(threadId);
+		break;
+	}
+}
+
 void FastText::startThreads() {
-	start_ = clock();
-	tokenCount_ = 0;
+	telemetry_->start(args_->thread);
+	tokenCount_ = start_.tokenCount;
 	loss_ = -1;
+	turn_ = 0;
+	finished_.assign(args_->thread, 0);
+	stop_ = false;
+	if (args_->evalEvery > 0) {
+		monitor_ = std::make_shared<Monitor>(std::make_shared<Evaluator>(args_->analogy, args_->similarity),
+			args_->evalEvery, tokenCount_, args_->patience, args_->minDelta, args_->thread);
+	} else if (args_->patience > 0) {
+		throw std::invalid_argument("early stopping needs the evaluation interval [-evalEvery]");
+	}
+	if (args_->perf) {
+		perf_ = std::make_shared<PerfReport>(args_->thread);
+	}
+	if (args_->profile) {
+		// trace events are kept for the first lines only
+		profiler_ = std::make_shared<Profiler>(args_->thread, args_->profileSample,
+			args_->profileTrace != "" ? 200000 : 0);
+	}
+	if (args_->checkpoint != "") {
+		checkpointer_ = std::make_shared<Checkpointer>(args_->checkpointInterval, args_->checkpointDeltas, telemetry::now());
+		if (args_->checkpointDeltas > 0) {
+			input_->trackDirty();
+			output_->trackDirty();
+		}
+		positions_.reset(new std::atomic<int64_t>[args_->thread]);
+		threadTokens_.reset(new std::atomic<int64_t>[args_->thread]);
+		for (int32_t i = 0; i < args_->thread; i++) {
+			positions_[i] = 0;
+			threadTokens_[i] = 0;
+		}
+	}
 	std::vector<std::thread> threads;
 	for (int32_t i = 0; i < args_->thread; i++) {
 		threads.push_back(std::thread([=]() {
 			trainThread(i);
 		}));
 	}
-	const int64_t ntokens = dict_->ntokens();
+	const int64_t ntokens = dict_->ntrainTokens();
 	// Same condition as trainThread
-	while (tokenCount_ < args_->epoch * ntokens) {
+	while (tokenCount_ < args_->epoch * ntokens && !stop_) {
 		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		loss_ = telemetry_->loss();
+		real progress = real(tokenCount_) / (args_->epoch * ntokens);
 		if (loss_ >= 0 && args_->verbose > 1) {
-			real progress = real(tokenCount_) / (args_->epoch * ntokens);
 			std::cerr << "\r";
 			printInfo(progress, loss_, std::cerr);
 		}
+		if (live_) {
+			live_->header->progress = progress;
+		}
+		if (telemetry_->due()) {
+			telemetry_->write(progress, args_->lr * (1.0 - progress));
+		}
+		if (checkpointer_ && checkpointer_->due(telemetry::now())) {
+			saveCheckpoint();
+		}
+		// a plateau stops the threads before another evaluation is started on the way out
+		if (monitor_ && monitor_->plateau()) {
+			stop_ = true;
+			break;
+		}
+		if (monitor_ && loss_ >= 0 && monitor_->due(tokenCount_)) {
+			monitor_->start(tokenCount_, progress, loss_, [this]() { return snapshot(); });
+		}
 	}
 	for (int32_t i = 0; i < args_->thread; i++) {
 		threads[i].join();
 	}
+	if (monitor_) {
+		monitor_->wait();
+	}
+	const real reached = std::min(real(1.0), real(tokenCount_) / (args_->epoch * ntokens));
+	if (stop_) {
+		std::cerr << "\rEarly stop at " << std::fixed << std::setprecision(1) << 100.0 * reached
+			<< "%, the evaluation score has not improved in " << args_->patience << " evaluations" << std::endl;
+	}
+	if (checkpointer_) {
+		checkpointer_->wait();
+		// the last checkpoint is the trained model, the previous model of the next update
+		checkpoint::Chain chain;
+		chain.generation = telemetry::now();
+		chain.sequence = 0;
+		checkpoint::save(args_->checkpoint, *args_, *dict_, *input_, *output_, progress(), chain);
+	}
+	if (live_) {
+		live_->header->progress = 1.0;
+	}
+	loss_ = telemetry_->loss();
+	if (perf_ && !perf_->any()) {
+		std::cerr << "\rperf_event_open failed, no hardware counters (check kernel.perf_event_paranoid)" << std::endl;
+	}
 	if (args_->verbose > 0) {
 		std::cerr << "\r";
-		printInfo(1.0, loss_, std::cerr);
+		printInfo(reached, loss_, std::cerr);
 		std::cerr << std::endl;
 	}
+	if (profiler_) {
+		profiler_->report(args_->modelToString(args_->model), std::cerr);
+		if (args_->profileTrace != "") {
+			profiler_->writeTrace(args_->profileTrace);
+		}
+	}
 }
 
 void FastText::saveVectors() {
+	int64_t phaseStart = telemetry::now();
 	int32_t nwords = dict_->nwords();
 	int32_t ntargets = dict_->ntargets();
 	int32_t nfeatures = dict_->nfeatures();
 
-	Vector vec(args_->dim);
+	if (args_->saveBinary) {
+		binmodel::save(args_->output + ".bin", *args_, *dict_, *input_, *output_, 1.0);
+	}
 
+	const int32_t threads = args_->thread;
+	const int32_t precision = args_->exportPrecision;
+	const int32_t shards = args_->exportShards;
 	if (nwords > 0) {
-		std::ofstream ofs(args_->output + ".source");
-		if (!ofs.is_open()) {
-			throw std::invalid_argument(args_->output + ".source" + " cannot be opened for saving source embedding.");
-		}
-		for (int32_t i = 0; i < nwords; i++){
-			std::string word = dict_->getWord(i);
-			vec.zero();
-			vec.addRow(*input_, i);
-			ofs << word << " " << vec << std::endl;
-		}
-		ofs.close();
+		exporter::exportText(args_->output + ".source", *input_, 0, nwords,
+			[&](int64_t i) { return dict_->getWord(i); }, threads, precision, shards);
 	}
-
 	if (nfeatures > 0) {
-		std::ofstream ofs(args_->output + ".feature");
-		if (!ofs.is_open()) {
-			throw std::invalid_argument(
-				args_->output + ".feature" + " cannot be opened for saving feature embedding.");
-		}
-
-		for (int32_t i = 0; i < nfeatures; i++) {
-			std::string feature = dict_->getFeature(i);
-			vec.zero();
-			vec.addRow(*input_, nwords + i);
-			ofs << feature << " " << vec << std::endl;
-		}
-
-		ofs.close();
+		exporter::exportText(args_->output + ".feature", *input_, nwords, nfeatures,
+			[&](int64_t i) { return dict_->getFeature(i); }, threads, precision, shards);
 	}
-
 	if (ntargets > 0) {
-		std::ofstream ofs(args_->output + ".target");
-		if (!ofs.is_open()) {
-			throw std::invalid_argument(args_->output + ".target" + " cannot be opened for saving target embedding.");
-		}
-		for (int32_t i = 0; i < ntargets; i++) {
-			std::string word = dict_->getTarget(i);
-			vec.zero();
-			vec.addRow(*output_, i);
-			ofs << word << " " << vec << std::endl;
-		}
-		ofs.close();
+		exporter::exportText(args_->output + ".target", *output_, 0, ntargets,
+			[&](int64_t i) { return dict_->getTarget(i); }, threads, precision, shards);
+	}
+	telemetry_->phase("save", (telemetry::now() - phaseStart) / 1e9);
+	telemetry_->write(1.0, 0.0);
+	if (memreport_) {
+		memreport_->phase("save");
+		memreport_->print(std::cerr);
+		memreport_->save(args_->output + ".memreport.json");
 	}
 }
 
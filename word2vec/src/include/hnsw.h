@@ -0,0 +1,587 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: hnsw.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: HNSW approximate nearest-neighbour graph over unit vectors, built in parallel and loaded with mmap.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "matrix.h"
+#include "neighbors.h"
+#include "kernels.h"
+#include "random.h"
+#include "real.h"
+#include "utils.h"
+
+/*
+* File layout, all offsets in bytes from the start of the file:
+*   Header                          64 bytes
+*   int32_t[n * (1 + M0)]           level 0 links of each node, count then ids
+*   int32_t[n]                      top level of each node
+*   int32_t pad                     only when the levels end off an 8-byte boundary
+*   int64_t[n + 1]                  start of the upper links of each node, 8-byte aligned
+*   int32_t[upper]                  links of levels 1..top of each node, (1 + M) per level
+*/
+namespace hnsw {
+
+static const uint32_t MAGIC = 0x57534E48; // "HNSW" on little-endian
+static const uint32_t VERSION = 2;
+static const int32_t MAX_LEVEL = 16;
+
+struct Header {
+	uint32_t magic;
+	uint32_t version;
+	int32_t M;
+	int32_t M0;
+	int64_t n;
+	int64_t dim;
+	int32_t maxLevel;
+	int32_t entry;
+	int64_t upper;
+	int64_t pad[2];
+};
+static_assert(sizeof(Header) == 64, "hnsw::Header must stay 64 bytes");
+
+/**
+* @Function: byte offset of the upper link offsets, the end of the levels rounded up to 8 bytes.
+*/
+inline size_t offsetsAt(int64_t n, int32_t M0) {
+	const size_t end = sizeof(Header) + n * (2 + M0) * sizeof(int32_t);
+	return (end + sizeof(int64_t) - 1) / sizeof(int64_t) * sizeof(int64_t);
+}
+
+/**
+* @Function: visited marks of one search, a new tag per search instead of clearing the marks.
+*/
+struct Visited {
+	std::vector<uint32_t> marks;
+	uint32_t tag;
+
+	Visited() : tag(0) {}
+
+	void begin(int64_t n) {
+		if (int64_t(marks.size()) != n || ++tag == 0) {
+			marks.assign(n, 0);
+			tag = 1;
+		}
+	}
+	inline bool visit(int32_t i) {
+		if (marks[i] == tag) {
+			return false;
+		}
+		marks[i] = tag;
+		return true;
+	}
+};
+
+/**
+* @Function: worse first, the order of the candidate heaps whose top is the best neighbour.
+*/
+inline bool worse(const neighbors::Neighbor& a, const neighbors::Neighbor& b) {
+	return neighbors::better(b, a);
+}
+
+}
+
+/**
+* @Function: hierarchical navigable small world graph, the vectors are unit rows and the
+* similarity is their dot product, the links are flat arrays so a saved graph is used in place.
+*/
+class Hnsw {
+  protected:
+	std::shared_ptr<Matrix> vectors_;
+	int32_t M_;
+	int32_t M0_;
+	int32_t efConstruction_;
+	int32_t efSearch_;
+	int32_t threads_;
+	int32_t maxLevel_;
+	int32_t entry_;
+	int64_t upper_;
+
+	// the arrays are owned by the stores after build, or point into mapped_ after load
+	std::vector<int32_t> level0Store_;
+	std::vector<int32_t> levelsStore_;
+	std::vector<int64_t> offsetsStore_;
+	std::vector<int32_t> upperStore_;
+	std::shared_ptr<char> mapped_;
+	int32_t* level0_;
+	int32_t* levels_;
+	int64_t* offsets_;
+	int32_t* upperLinks_;
+
+	// per-node locks of the links and the lock of the entry point, used while building only
+	std::unique_ptr<std::mutex[]> locks_;
+	std::mutex entryLock_;
+
+	inline int32_t* links(int32_t node, int32_t level) const {
+		if (level == 0) {
+			return level0_ + int64_t(node) * (1 + M0_);
+		}
+		return upperLinks_ + offsets_[node] + int64_t(level - 1) * (1 + M_);
+	}
+	inline real similarity(const real* q, int32_t node) const {
+		return kernels::dot<0>(q, vectors_->row(node), vectors_->cols());
+	}
+
+	void copyLinks(int32_t, int32_t, bool, std::vector<int32_t>&) const;
+	void searchLayer(const real*, const std::vector<neighbors::Neighbor>&, int32_t, int32_t, bool,
+		hnsw::Visited&, std::vector<neighbors::Neighbor>&) const;
+	void select(const std::vector<neighbors::Neighbor>&, int32_t, std::vector<neighbors::Neighbor>&) const;
+	void connect(int32_t, int32_t, const std::vector<neighbors::Neighbor>&);
+	void insert(int32_t, hnsw::Visited&);
+
+  public:
+	explicit Hnsw(std::shared_ptr<Matrix>);
+
+	inline int64_t size() const {
+		return vectors_->rows();
+	}
+	inline void setEfSearch(int32_t ef) {
+		efSearch_ = std::max(ef, 1);
+	}
+	inline void setThreads(int32_t threads) {
+		threads_ = std::max(threads, 1);
+	}
+	void build(int32_t, int32_t, int32_t, uint64_t);
+	void save(const std::string&) const;
+	void load(const std::string&);
+	void search(const real*, int32_t, const std::vector<int64_t>&, hnsw::Visited&,
+		std::vector<neighbors::Neighbor>&) const;
+	void search(const Matrix&, int32_t, const std::vector<std::vector<int64_t>>&,
+		std::vector<std::vector<neighbors::Neighbor>>&) const;
+	double recall(const NearestNeighbors&, int32_t, int64_t) const;
+	int64_t memoryUsage() const;
+};
+
+/**
+* @Function: index over the rows of vectors, which must already be unit rows.
+*/
+Hnsw::Hnsw(std::shared_ptr<Matrix> vectors) : vectors_(vectors), M_(16), M0_(32), efConstruction_(200),
+	efSearch_(50), threads_(1), maxLevel_(-1), entry_(-1), upper_(0), level0_(nullptr), levels_(nullptr),
+	offsets_(nullptr), upperLinks_(nullptr) {}
+
+/**
+* @Function: the links of a node at a level, under its lock while the graph is being built.
+*/
+void Hnsw::copyLinks(int32_t node, int32_t level, bool building, std::vector<int32_t>& out) const {
+	if (building) {
+		locks_[node].lock();
+	}
+	const int32_t* l = links(node, level);
+	out.assign(l + 1, l + 1 + l[0]);
+	if (building) {
+		locks_[node].unlock();
+	}
+}
+
+/**
+* @Function: best-first search of one level from the entry points, out gets the ef closest nodes, best first.
+*/
+void Hnsw::searchLayer(const real* q, const std::vector<neighbors::Neighbor>& entries, int32_t ef, int32_t level,
+		bool building, hnsw::Visited& visited, std::vector<neighbors::Neighbor>& out) const {
+	// candidates have the best on top, results the worst
+	std::vector<neighbors::Neighbor> candidates;
+	std::vector<neighbors::Neighbor> results;
+	std::vector<int32_t> adjacent;
+	visited.begin(size());
+	for (const neighbors::Neighbor& e : entries) {
+		if (visited.visit(e.id)) {
+			candidates.push_back(e);
+			results.push_back(e);
+		}
+	}
+	std::make_heap(candidates.begin(), candidates.end(), hnsw::worse);
+	std::make_heap(results.begin(), results.end(), neighbors::better);
+	while (int32_t(results.size()) > ef) {
+		std::pop_heap(results.begin(), results.end(), neighbors::better);
+		results.pop_back();
+	}
+	while (!candidates.empty()) {
+		neighbors::Neighbor c = candidates.front();
+		std::pop_heap(candidates.begin(), candidates.end(), hnsw::worse);
+		candidates.pop_back();
+		if (int32_t(results.size()) >= ef && neighbors::better(results.front(), c)) {
+			break;
+		}
+		copyLinks(c.id, level, building, adjacent);
+		for (int32_t e : adjacent) {
+			if (!visited.visit(e)) {
+				continue;
+			}
+			neighbors::Neighbor n = { similarity(q, e), e };
+			if (int32_t(results.size()) < ef || neighbors::better(n, results.front())) {
+				candidates.push_back(n);
+				std::push_heap(candidates.begin(), candidates.end(), hnsw::worse);
+				results.push_back(n);
+				std::push_heap(results.begin(), results.end(), neighbors::better);
+				if (int32_t(results.size()) > ef) {
+					std::pop_heap(results.begin(), results.end(), neighbors::better);
+					results.pop_back();
+				}
+			}
+		}
+	}
+	std::sort(results.begin(), results.end(), neighbors::better);
+	out.swap(results);
+}
+
+/**
+* @Function: the heuristic of the HNSW paper, a candidate is kept when it is closer to the base
+* than to every neighbour kept before it, candidates are sorted best first.
+*/
+void Hnsw::select(const std::vector<neighbors::Neighbor>& candidates, int32_t m,
+		std::vector<neighbors::Neighbor>& out) const {
+	out.clear();
+	for (const neighbors::Neighbor& c : candidates) {
+		if (int32_t(out.size()) >= m) {
+			break;
+		}
+		bool keep = true;
+		for (const neighbors::Neighbor& r : out) {
+			if (similarity(vectors_->row(c.id), r.id) > c.score) {
+				keep = false;
+				break;
+			}
+		}
+		if (keep) {
+			out.push_back(c);
+		}
+	}
+}
+
+/**
+* @Function: link node to its selected neighbours at a level and back, a full neighbour list is pruned again.
+*/
+void Hnsw::connect(int32_t node, int32_t level, const std::vector<neighbors::Neighbor>& selected) {
+	const int32_t cap = level == 0 ? M0_ : M_;
+	{
+		std::lock_guard<std::mutex> lock(locks_[node]);
+		int32_t* l = links(node, level);
+		l[0] = 0;
+		for (const neighbors::Neighbor& s : selected) {
+			l[1 + l[0]++] = s.id;
+		}
+	}
+	std::vector<neighbors::Neighbor> candidates;
+	std::vector<neighbors::Neighbor> kept;
+	for (const neighbors::Neighbor& s : selected) {
+		std::lock_guard<std::mutex> lock(locks_[s.id]);
+		int32_t* l = links(s.id, level);
+		if (l[0] < cap) {
+			l[1 + l[0]++] = node;
+			continue;
+		}
+		const real* base = vectors_->row(s.id);
+		candidates.clear();
+		candidates.push_back({ s.score, node });
+		for (int32_t j = 1; j <= l[0]; j++) {
+			candidates.push_back({ similarity(base, l[j]), l[j] });
+		}
+		std::sort(candidates.begin(), candidates.end(), neighbors::better);
+		select(candidates, cap, kept);
+		l[0] = 0;
+		for (const neighbors::Neighbor& k : kept) {
+			l[1 + l[0]++] = k.id;
+		}
+	}
+}
+
+/**
+* @Function: insert a node whose level is drawn, holding the entry lock when it becomes the new entry point.
+*/
+void Hnsw::insert(int32_t node, hnsw::Visited& visited) {
+	const int32_t level = levels_[node];
+	std::unique_lock<std::mutex> entryLock(entryLock_);
+	const int32_t maxLevel = maxLevel_;
+	const int32_t entry = entry_;
+	if (level <= maxLevel) {
+		entryLock.unlock();
+	}
+	const real* q = vectors_->row(node);
+	neighbors::Neighbor current = { similarity(q, entry), entry };
+	std::vector<int32_t> adjacent;
+	for (int32_t l = maxLevel; l > level; l--) {
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			copyLinks(current.id, l, true, adjacent);
+			for (int32_t e : adjacent) {
+				real s = similarity(q, e);
+				if (s > current.score) {
+					current = { s, e };
+					changed = true;
+				}
+			}
+		}
+	}
+	std::vector<neighbors::Neighbor> entries(1, current);
+	std::vector<neighbors::Neighbor> found;
+	std::vector<neighbors::Neighbor> selected;
+	for (int32_t l = std::min(level, maxLevel); l >= 0; l--) {
+		searchLayer(q, entries, efConstruction_, l, true, visited, found);
+		select(found, M_, selected);
+		connect(node, l, selected);
+		entries.swap(found);
+	}
+	if (level > maxLevel) {
+		entry_ = node;
+		maxLevel_ = level;
+	}
+}
+
+/**
+* @Function: build the graph with M links per node (2M on level 0), the levels are drawn from philox
+* keyed by the seed and the nodes are inserted by all the threads.
+*/
+void Hnsw::build(int32_t M, int32_t efConstruction, int32_t threads, uint64_t seed) {
+	const int64_t n = size();
+	if (n == 0 || n > INT32_MAX) {
+		throw std::invalid_argument("hnsw needs between 1 and 2^31 - 1 vectors.");
+	}
+	M_ = std::max(M, 2);
+	M0_ = 2 * M_;
+	efConstruction_ = std::max(efConstruction, M_);
+	threads_ = std::max(threads, 1);
+	mapped_.reset();
+
+	const double mL = 1.0 / std::log(double(M_));
+	levelsStore_.resize(n);
+	offsetsStore_.resize(n + 1);
+	offsetsStore_[0] = 0;
+	for (int64_t i = 0; i < n; i++) {
+		uint32_t c[4] = { uint32_t(i), uint32_t(uint64_t(i) >> 32), 0, 0x484E5357u };
+		rng::philox(c, seed);
+		double u = (double(c[0] >> 8) + 1.0) / double(1 << 24);
+		levelsStore_[i] = std::min(int32_t(-std::log(u) * mL), hnsw::MAX_LEVEL);
+		offsetsStore_[i + 1] = offsetsStore_[i] + int64_t(levelsStore_[i]) * (1 + M_);
+	}
+	upper_ = offsetsStore_[n];
+	level0Store_.assign(n * (1 + M0_), 0);
+	upperStore_.assign(std::max<int64_t>(upper_, 1), 0);
+	level0_ = level0Store_.data();
+	levels_ = levelsStore_.data();
+	offsets_ = offsetsStore_.data();
+	upperLinks_ = upperStore_.data();
+	locks_.reset(new std::mutex[n]);
+
+	entry_ = 0;
+	maxLevel_ = levels_[0];
+	std::atomic<int64_t> next(1);
+	utils::parallel(threads_, [&](int32_t) {
+		hnsw::Visited visited;
+		for (int64_t i = next++; i < n; i = next++) {
+			insert(int32_t(i), visited);
+		}
+	});
+	locks_.reset();
+}
+
+/**
+* @Function: write the graph to path.tmp and rename it over path.
+*/
+void Hnsw::save(const std::string& path) const {
+	if (level0_ == nullptr) {
+		throw std::invalid_argument("the hnsw graph is not built.");
+	}
+	const int64_t n = size();
+	hnsw::Header h;
+	std::memset(&h, 0, sizeof(h));
+	h.magic = hnsw::MAGIC;
+	h.version = hnsw::VERSION;
+	h.M = M_;
+	h.M0 = M0_;
+	h.n = n;
+	h.dim = vectors_->cols();
+	h.maxLevel = maxLevel_;
+	h.entry = entry_;
+	h.upper = upper_;
+	const std::string tmp = path + ".tmp";
+	std::ofstream ofs(tmp, std::ios::binary);
+	if (!ofs.is_open()) {
+		throw std::invalid_argument(tmp + " cannot be opened for saving the index.");
+	}
+	ofs.write((char*)&h, sizeof(h));
+	ofs.write((char*)level0_, n * (1 + M0_) * sizeof(int32_t));
+	ofs.write((char*)levels_, n * sizeof(int32_t));
+	const size_t pad = hnsw::offsetsAt(n, M0_) - (sizeof(h) + n * (2 + M0_) * sizeof(int32_t));
+	if (pad != 0) {
+		int32_t zero = 0;
+		ofs.write((char*)&zero, pad);
+	}
+	ofs.write((char*)offsets_, (n + 1) * sizeof(int64_t));
+	ofs.write((char*)upperLinks_, upper_ * sizeof(int32_t));
+	ofs.close();
+	if (!ofs) {
+		throw std::invalid_argument(tmp + " could not be written.");
+	}
+	if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+		throw std::invalid_argument(tmp + " cannot be renamed to " + path);
+	}
+}
+
+/**
+* @Function: map a saved graph, it must have been built over the same vectors.
+*/
+void Hnsw::load(const std::string& path) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		throw std::invalid_argument(path + " cannot be opened for loading the index.");
+	}
+	const size_t bytes = st.st_size;
+	void* p = bytes < sizeof(hnsw::Header) ? MAP_FAILED : mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED) {
+		throw std::invalid_argument(path + " is not an hnsw index.");
+	}
+	std::shared_ptr<char> mapped((char*)p, [bytes](char* q) { munmap(q, bytes); });
+	const hnsw::Header& h = *(const hnsw::Header*)p;
+	if (h.magic != hnsw::MAGIC || h.version != hnsw::VERSION) {
+		throw std::invalid_argument(path + " is not an hnsw index.");
+	}
+	if (h.n != size() || h.dim != vectors_->cols()) {
+		throw std::invalid_argument(path + " was built over other vectors.");
+	}
+	const int64_t n = h.n;
+	const size_t level0 = sizeof(hnsw::Header);
+	const size_t levels = level0 + n * (1 + h.M0) * sizeof(int32_t);
+	const size_t offsets = hnsw::offsetsAt(n, h.M0);
+	const size_t upper = offsets + (n + 1) * sizeof(int64_t);
+	if (upper + h.upper * sizeof(int32_t) > bytes) {
+		throw std::invalid_argument(path + " is truncated.");
+	}
+	mapped_ = mapped;
+	level0Store_.clear();
+	levelsStore_.clear();
+	offsetsStore_.clear();
+	upperStore_.clear();
+	M_ = h.M;
+	M0_ = h.M0;
+	maxLevel_ = h.maxLevel;
+	entry_ = h.entry;
+	upper_ = h.upper;
+	// the mapping is read-only, the graph is never written after load
+	level0_ = (int32_t*)(mapped_.get() + level0);
+	levels_ = (int32_t*)(mapped_.get() + levels);
+	offsets_ = (int64_t*)(mapped_.get() + offsets);
+	upperLinks_ = (int32_t*)(mapped_.get() + upper);
+}
+
+/**
+* @Function: top-k of a unit query with a beam of efSearch, the excluded rows are searched past and dropped.
+*/
+void Hnsw::search(const real* q, int32_t k, const std::vector<int64_t>& exclude, hnsw::Visited& visited,
+		std::vector<neighbors::Neighbor>& out) const {
+	out.clear();
+	if (entry_ < 0 || k <= 0) {
+		return;
+	}
+	neighbors::Neighbor current = { similarity(q, entry_), entry_ };
+	std::vector<int32_t> adjacent;
+	for (int32_t l = maxLevel_; l > 0; l--) {
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			copyLinks(current.id, l, false, adjacent);
+			for (int32_t e : adjacent) {
+				real s = similarity(q, e);
+				if (s > current.score) {
+					current = { s, e };
+					changed = true;
+				}
+			}
+		}
+	}
+	std::vector<neighbors::Neighbor> found;
+	const int32_t ef = std::max<int32_t>(efSearch_, k + exclude.size());
+	searchLayer(q, std::vector<neighbors::Neighbor>(1, current), ef, 0, false, visited, found);
+	for (const neighbors::Neighbor& f : found) {
+		if (int32_t(out.size()) == k) {
+			break;
+		}
+		if (std::find(exclude.begin(), exclude.end(), f.id) == exclude.end()) {
+			out.push_back(f);
+		}
+	}
+}
+
+/**
+* @Function: the search of NearestNeighbors, the queries are split over the threads.
+*/
+void Hnsw::search(const Matrix& queries, int32_t k, const std::vector<std::vector<int64_t>>& exclude,
+		std::vector<std::vector<neighbors::Neighbor>>& results) const {
+	if (queries.cols() != vectors_->cols()) {
+		throw std::invalid_argument("the queries do not have dim " + std::to_string(vectors_->cols()));
+	}
+	Matrix unit(queries);
+	NearestNeighbors::normalize(unit, 1);
+	const int64_t nq = unit.rows();
+	results.assign(nq, std::vector<neighbors::Neighbor>());
+	const int32_t threads = int32_t(std::max<int64_t>(1, std::min<int64_t>(threads_, nq)));
+	const std::vector<int64_t> none;
+	utils::parallel(threads, [&](int32_t t) {
+		hnsw::Visited visited;
+		for (int64_t q = nq * t / threads; q < nq * (t + 1) / threads; q++) {
+			search(unit.row(q), k, exclude.empty() ? none : exclude[q], visited, results[q]);
+		}
+	});
+}
+
+/**
+* @Function: recall@k against the exact search, over sample rows spread over the vectors, each used as a query.
+*/
+double Hnsw::recall(const NearestNeighbors& exact, int32_t k, int64_t sample) const {
+	const int64_t n = size();
+	sample = std::max<int64_t>(1, std::min(sample, n));
+	Matrix queries(sample, vectors_->cols());
+	std::vector<std::vector<int64_t>> exclude(sample);
+	for (int64_t i = 0; i < sample; i++) {
+		int64_t row = i * n / sample;
+		std::memcpy(queries.row(i), vectors_->row(row), vectors_->cols() * sizeof(real));
+		exclude[i].push_back(row);
+	}
+	std::vector<std::vector<neighbors::Neighbor>> truth;
+	std::vector<std::vector<neighbors::Neighbor>> found;
+	exact.search(queries, k, exclude, truth);
+	search(queries, k, exclude, found);
+	int64_t hits = 0;
+	int64_t total = 0;
+	for (int64_t i = 0; i < sample; i++) {
+		total += truth[i].size();
+		for (const neighbors::Neighbor& t : truth[i]) {
+			for (const neighbors::Neighbor& f : found[i]) {
+				if (f.id == t.id) {
+					hits++;
+					break;
+				}
+			}
+		}
+	}
+	return total == 0 ? 1.0 : double(hits) / total;
+}
+
+int64_t Hnsw::memoryUsage() const {
+	return sizeof(*this) + level0Store_.capacity() * sizeof(int32_t) + levelsStore_.capacity() * sizeof(int32_t)
+		+ offsetsStore_.capacity() * sizeof(int64_t) + upperStore_.capacity() * sizeof(int32_t);
+}
@@ -0,0 +1,79 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: kernels.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: dense vector kernels, specialized on the embedding dimension.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "real.h"
+
+/*
+  N > 0 fixes the vector length at compile time so the loops are fully
+  unrolled; N == 0 is the generic path and uses the runtime length n.
+*/
+namespace kernels {
+
+static const int32_t LANES = 8;
+
+template <int32_t N>
+inline real dot(const real* __restrict a, const real* __restrict b, int64_t n) {
+	const int64_t len = N > 0 ? N : n;
+	// independent partial sums let the compiler vectorize the reduction
+	real acc[LANES] = { 0 };
+	int64_t j = 0;
+	for (; j + LANES <= len; j += LANES) {
+		for (int32_t k = 0; k < LANES; k++) {
+			acc[k] += a[j + k] * b[j + k];
+		}
+	}
+	// a fixed N that is a multiple of LANES has no tail
+	if (N == 0 || N % LANES != 0) {
+		for (; j < len; j++) {
+			acc[0] += a[j] * b[j];
+		}
+	}
+	real d = 0.0;
+	for (int32_t k = 0; k < LANES; k++) {
+		d += acc[k];
+	}
+	return d;
+}
+
+template <int32_t N>
+inline void axpy(real* __restrict y, real a, const real* __restrict x, int64_t n) {
+	const int64_t len = N > 0 ? N : n;
+	for (int64_t j = 0; j < len; j++) {
+		y[j] += a * x[j];
+	}
+}
+
+template <int32_t N>
+inline void add(real* __restrict y, const real* __restrict x, int64_t n) {
+	const int64_t len = N > 0 ? N : n;
+	for (int64_t j = 0; j < len; j++) {
+		y[j] += x[j];
+	}
+}
+
+template <int32_t N>
+inline void scale(real* y, real a, int64_t n) {
+	const int64_t len = N > 0 ? N : n;
+	for (int64_t j = 0; j < len; j++) {
+		y[j] *= a;
+	}
+}
+
+template <int32_t N>
+inline void zero(real* y, int64_t n) {
+	const int64_t len = N > 0 ? N : n;
+	for (int64_t j = 0; j < len; j++) {
+		y[j] = 0.0;
+	}
+}
+
+}
@@ -0,0 +1,116 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: lrucache.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: thread-safe LRU cache split into shards that each have their own lock.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+
+/**
+* @Function: a key goes to the shard of its hash, so threads looking up different keys rarely
+* wait on the same lock, each shard evicts its least recently used entry when full.
+*/
+template <class K, class V, class Hash = std::hash<K>>
+class LruCache {
+  protected:
+	struct Shard {
+		std::mutex mutex;
+		// most recently used first
+		std::list<std::pair<K, V>> entries;
+		std::unordered_map<K, typename std::list<std::pair<K, V>>::iterator, Hash> index;
+	};
+
+	std::vector<std::unique_ptr<Shard>> shards_;
+	size_t capacity_;
+	Hash hash_;
+	std::atomic<int64_t> hits_;
+	std::atomic<int64_t> misses_;
+
+	inline Shard& shard(const K& key) {
+		return *shards_[hash_(key) % shards_.size()];
+	}
+
+  public:
+	LruCache(size_t capacity, int32_t shards) : capacity_(0), hits_(0), misses_(0) {
+		shards = std::max(shards, 1);
+		for (int32_t i = 0; i < shards; i++) {
+			shards_.emplace_back(new Shard());
+		}
+		// the capacity is split evenly, a shard keeps at least one entry unless the cache is off
+		capacity_ = capacity == 0 ? 0 : std::max<size_t>(1, (capacity + shards - 1) / shards);
+	}
+
+	/**
+	* @Function: copy the value of key into value and mark it used, false if absent.
+	*/
+	bool get(const K& key, V& value) {
+		if (capacity_ == 0) {
+			misses_++;
+			return false;
+		}
+		Shard& s = shard(key);
+		std::lock_guard<std::mutex> lock(s.mutex);
+		auto it = s.index.find(key);
+		if (it == s.index.end()) {
+			misses_++;
+			return false;
+		}
+		s.entries.splice(s.entries.begin(), s.entries, it->second);
+		value = it->second->second;
+		hits_++;
+		return true;
+	}
+
+	/**
+	* @Function: insert or replace the value of key, evicting the least recently used entry of its shard.
+	*/
+	void put(const K& key, const V& value) {
+		if (capacity_ == 0) {
+			return;
+		}
+		Shard& s = shard(key);
+		std::lock_guard<std::mutex> lock(s.mutex);
+		auto it = s.index.find(key);
+		if (it != s.index.end()) {
+			it->second->second = value;
+			s.entries.splice(s.entries.begin(), s.entries, it->second);
+			return;
+		}
+		if (s.entries.size() >= capacity_) {
+			s.index.erase(s.entries.back().first);
+			s.entries.pop_back();
+		}
+		s.entries.emplace_front(key, value);
+		s.index.emplace(key, s.entries.begin());
+	}
+
+	size_t size() {
+		size_t n = 0;
+		for (auto& s : shards_) {
+			std::lock_guard<std::mutex> lock(s->mutex);
+			n += s->entries.size();
+		}
+		return n;
+	}
+
+	inline int64_t hits() const {
+		return hits_;
+	}
+
+	inline int64_t misses() const {
+		return misses_;
+	}
+};
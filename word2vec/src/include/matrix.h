@@ -11,10 +11,24 @@
 #define MATRIX_VECTOR
 
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <vector>
+#include <memory>
+#include <algorithm>
 #include<iomanip>
 
+#include <sys/mman.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <fstream>
+#include <string>
+#endif
+
 #include <assert.h>
 #include "real.h"
 
@@ -24,25 +38,107 @@
 #include <stdexcept>
 
 #include "utils.h"
+#include "kernels.h"
+#include "random.h"
 
 class Matrix {
   protected:
-    std::vector<real> data_;
+    // 64-byte aligned rows, large matrices are fresh anonymous pages untouched until initialized
+    std::shared_ptr<real> storage_;
+    real* data_;
     const int64_t m_;
     const int64_t n_;
+    // per-row dirty flags of the incremental checkpoints, empty unless tracked, a byte per
+    // row so marking a row is a plain load, and a plain store the first time, never a
+    // read-modify-write of a shared word
+    std::vector<uint8_t> dirty_;
+
+    static const int64_t ALIGN = 64;
+    static const int64_t MMAP_THRESHOLD = 1 << 20;
+
+    /**
+     * Mask of the online NUMA nodes, 0 on a single node or when unknown.
+     */
+    static uint64_t numaNodes() {
+#ifdef __linux__
+        std::ifstream ifs("/sys/devices/system/node/online");
+        std::string list;
+        if (!(ifs >> list)) {
+            return 0;
+        }
+        // ranges like "0-1,4", nodes past 63 are left out of the mask
+        uint64_t mask = 0;
+        size_t pos = 0;
+        while (pos < list.size()) {
+            size_t comma = list.find(',', pos);
+            std::string range = list.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+            size_t dash = range.find('-');
+            int first = std::atoi(range.c_str());
+            int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+            for (int node = first; node <= last && node < 64; node++) {
+                mask |= uint64_t(1) << node;
+            }
+            if (comma == std::string::npos) {
+                break;
+            }
+            pos = comma + 1;
+        }
+        return (mask & (mask - 1)) != 0 ? mask : 0;
+#else
+        return 0;
+#endif
+    }
+
+    /**
+     * Interleaves the pages of a mapping over the NUMA nodes, the Hogwild threads
+     * touch rows at random so no node placement would be local to one thread,
+     * spreading the pages spreads the memory bandwidth. No-op on a single node.
+     */
+    static void interleave(void* p, size_t bytes) {
+#ifdef __linux__
+        static const uint64_t nodes = numaNodes();
+        if (nodes != 0) {
+            // a failure leaves the default first-touch policy
+            syscall(__NR_mbind, p, bytes, MPOL_INTERLEAVE, &nodes, 64, 0);
+        }
+#endif
+    }
+
+    static std::shared_ptr<real> allocate(int64_t count) {
+        size_t bytes = std::max<size_t>(count * sizeof(real), ALIGN);
+        if (bytes >= MMAP_THRESHOLD) {
+            void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            // before any page is touched, the policy applies to the first touch
+            interleave(p, bytes);
+            return std::shared_ptr<real>((real*)p, [bytes](real* q) { munmap(q, bytes); });
+        }
+        void* p = nullptr;
+        if (posix_memalign(&p, ALIGN, bytes) != 0) {
+            throw std::bad_alloc();
+        }
+        std::memset(p, 0, bytes);
+        return std::shared_ptr<real>((real*)p, [](real* q) { free(q); });
+    }
 
   public:
     Matrix() : Matrix(0, 0) {}
-    Matrix(int64_t m, int64_t n) : data_(m * n), m_(m), n_(n) {}
-    Matrix(const Matrix&) = default;
+    Matrix(int64_t m, int64_t n) : storage_(allocate(m * n)), data_(storage_.get()), m_(m), n_(n) {}
+    // rows in memory owned elsewhere, storage keeps it alive, e.g. a shared memory segment
+    Matrix(std::shared_ptr<real> storage, int64_t m, int64_t n) : storage_(storage), data_(storage_.get()), m_(m), n_(n) {}
+    Matrix(const Matrix& other) : Matrix(other.m_, other.n_) {
+        std::memcpy(data_, other.data_, m_ * n_ * sizeof(real));
+    }
     Matrix& operator=(const Matrix&) = delete;
 
     inline real* data() {
-        return data_.data();
+        return data_;
     }
 
     inline const real* data() const {
-        return data_.data();
+        return data_;
     }
 
     inline const real& at(int64_t i, int64_t j) const {
@@ -53,6 +149,46 @@ class Matrix {
         return data_[i * n_ + j];
     }
 
+    inline real* row(int64_t i) {
+        return data_ + i * n_;
+    }
+
+    inline const real* row(int64_t i) const {
+        return data_ + i * n_;
+    }
+
+    void trackDirty() {
+        dirty_.assign(m_, 0);
+    }
+
+    inline bool tracksDirty() const {
+        return !dirty_.empty();
+    }
+
+    inline void markDirty(int64_t i) {
+        // tested first, a flag already set is only read and its line stays shared between the threads
+        if (!dirty_.empty() && dirty_[i] == 0) {
+            dirty_[i] = 1;
+        }
+    }
+
+    /**
+     * Clears the flag of a row, true if it was set.
+     */
+    inline bool takeDirty(int64_t i) {
+        if (dirty_[i] == 0) {
+            return false;
+        }
+        dirty_[i] = 0;
+        return true;
+    }
+
+    void clearDirty(int64_t ib, int64_t ie) {
+        if (!dirty_.empty()) {
+            std::memset(dirty_.data() + ib, 0, ie - ib);
+        }
+    }
+
     inline int64_t size(int64_t dim) const {
         assert(dim == 0 || dim == 1);
         if (dim == 0) {
@@ -67,26 +203,45 @@ class Matrix {
         return n_;
     }
 
-    void zero() {
-        std::fill(data_.begin(), data_.end(), real(0.0));
-    }
-
-    void uniform(real a) {
-        std::minstd_rand rng(1);
-        std::uniform_real_distribution<> uniform(-a, a);
-        for (int64_t i = 0; i < (m_ * n_); i++) {
-            data_[i] = uniform(rng);
-        }
+    /**
+     * Zeroes the rows, the threads split the rows, the node of each page is
+     * the one interleave gave it, not the node of the thread touching it.
+     */
+    void zero(int32_t threads = 1) {
+        utils::parallel(threads, [&](int32_t t) {
+            int64_t ib = m_ * t / threads;
+            int64_t ie = m_ * (t + 1) / threads;
+            std::memset(row(ib), 0, (ie - ib) * n_ * sizeof(real));
+        });
+    }
+
+    /**
+     * Uniform values in [-a, a) drawn from philox keyed by the seed, the
+     * value of (i, j) depends on the seed only, not on the thread count.
+     */
+    void uniform(real a, int32_t threads = 1, uint64_t seed = 1) {
+        const int64_t blocks = (n_ + 3) / 4;
+        utils::parallel(threads, [&](int32_t t) {
+            int64_t ib = m_ * t / threads;
+            int64_t ie = m_ * (t + 1) / threads;
+            for (int64_t i = ib; i < ie; i++) {
+                real* r = row(i);
+                for (int64_t b = 0; b < blocks; b++) {
+                    uint32_t c[4] = { uint32_t(i), uint32_t(uint64_t(i) >> 32), uint32_t(b), 0 };
+                    rng::philox(c, seed);
+                    for (int64_t k = 0; k < 4 && 4 * b + k < n_; k++) {
+                        r[4 * b + k] = a * (real(2.0) * real(c[k] >> 8) * (real(1.0) / real(1 << 24)) - real(1.0));
+                    }
+                }
+            }
+        });
     }
 
     real dotRow(const std::vector<real>& vec, int64_t i) const {
         assert(i >= 0);
         assert(i < m_);
         assert(vec.size() == n_);
-        real d = 0.0;
-        for (int64_t j = 0; j < n_; j++) {
-            d += at(i, j) * vec[j];
-        }
+        real d = kernels::dot<0>(row(i), vec.data(), n_);
         if (std::isnan(d)) {
             throw std::runtime_error("Encountered NaN.");
         }
@@ -97,9 +252,8 @@ class Matrix {
         assert(i >= 0);
         assert(i < m_);
         assert(vec.size() == n_);
-        for (int64_t j = 0; j < n_; j++) {
-            data_[i * n_ + j] += a * vec[j];
-        }
+        kernels::axpy<0>(row(i), a, vec.data(), n_);
+        markDirty(i);
     }
 
     void multiplyRow(const std::vector<real>& nums, int64_t ib, int64_t ie) {
@@ -150,17 +304,42 @@ class Matrix {
         }
     }
 
+    int64_t memoryUsage() const {
+        return sizeof(*this) + m_ * n_ * sizeof(real) + dirty_.capacity();
+    }
+
     void save(std::ostream& out) {
         out.write((char*)&m_, sizeof(int64_t));
         out.write((char*)&n_, sizeof(int64_t));
-        out.write((char*)data_.data(), m_ * n_ * sizeof(real));
-    }
-
-    void load(std::istream& in) {
-        in.read((char*)&m_, sizeof(int64_t));
-        in.read((char*)&n_, sizeof(int64_t));
-        data_ = std::vector<real>(m_ * n_);
-        in.read((char*)data_.data(), m_ * n_ * sizeof(real));
+        out.write((char*)data_, m_ * n_ * sizeof(real));
+    }
+
+    /**
+     * Reads a matrix written by save, nullptr when the stream ends early or
+     * the sizes are negative, overflow or run past the end of a seekable stream,
+     * so a corrupt file is never allocated.
+     */
+    static std::shared_ptr<Matrix> read(std::istream& in) {
+        int64_t m = -1;
+        int64_t n = -1;
+        in.read((char*)&m, sizeof(int64_t));
+        in.read((char*)&n, sizeof(int64_t));
+        if (!in || m < 0 || n < 0 || (n > 0 && m > INT64_MAX / int64_t(sizeof(real)) / n)) {
+            return nullptr;
+        }
+        const int64_t bytes = m * n * int64_t(sizeof(real));
+        const std::streampos pos = in.tellg();
+        if (pos != std::streampos(-1)) {
+            in.seekg(0, std::ios::end);
+            const std::streampos end = in.tellg();
+            in.seekg(pos);
+            if (!in || int64_t(end - pos) < bytes) {
+                return nullptr;
+            }
+        }
+        std::shared_ptr<Matrix> matrix = std::make_shared<Matrix>(m, n);
+        in.read((char*)matrix->data_, bytes);
+        return in ? matrix : nullptr;
     }
 
     void dump(std::ostream& out) const {
@@ -209,6 +388,10 @@ class Vector {
         std::fill(data_.begin(), data_.end(), real(0.0));
     }
 
+    int64_t memoryUsage() const {
+        return sizeof(*this) + data_.capacity() * sizeof(real);
+    }
+
     real norm() const {
         real sum = 0;
         for (int64_t i = 0; i < size(); i++) {
@@ -241,18 +424,14 @@ class Vector {
         assert(i >= 0);
         assert(i < A.size(0));
         assert(size() == A.size(1));
-        for (int64_t j = 0; j < A.size(1); j++) {
-            data_[j] += A.at(i, j);
-        }
+        kernels::add<0>(data_.data(), A.row(i), A.size(1));
     }
 
     void addRow(const Matrix& A, int64_t i, real a) {
         assert(i >= 0);
         assert(i < A.size(0));
         assert(size() == A.size(1));
-        for (int64_t j = 0; j < A.size(1); j++) {
-            data_[j] += a * A.at(i, j);
-        }
+        kernels::axpy<0>(data_.data(), a, A.row(i), A.size(1));
     }
 
     void mul(const Matrix& A, const Vector& vec) {
@@ -0,0 +1,190 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: memreport.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: memory accounting of the data structures and peak RSS per phase.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "telemetry.h"
+
+namespace memreport {
+
+/**
+* @Function: bytes of a string, heap buffer beyond the small string included.
+*/
+inline int64_t bytes(const std::string& s) {
+	int64_t heap = s.capacity() > 15 ? s.capacity() + 1 : 0;
+	return sizeof(std::string) + heap;
+}
+
+/**
+* @Function: bytes of a vector of plain values.
+*/
+template <class T>
+inline int64_t bytes(const std::vector<T>& v) {
+	return sizeof(v) + v.capacity() * sizeof(T);
+}
+
+/**
+* @Function: bytes of a vector of strings.
+*/
+inline int64_t bytes(const std::vector<std::string>& v) {
+	int64_t n = sizeof(v) + (v.capacity() - v.size()) * sizeof(std::string);
+	for (size_t i = 0; i < v.size(); i++) {
+		n += bytes(v[i]);
+	}
+	return n;
+}
+
+/**
+* @Function: bytes of a hash map from strings, node is next pointer, value and cached hash.
+*/
+template <class V>
+inline int64_t bytes(const std::unordered_map<std::string, V>& m) {
+	int64_t n = sizeof(m) + m.bucket_count() * sizeof(void*);
+	for (auto it = m.cbegin(); it != m.cend(); ++it) {
+		n += sizeof(void*) + sizeof(size_t) + sizeof(V) + bytes(it->first);
+	}
+	return n;
+}
+
+/**
+* @Function: bytes of a tree map of strings, node is color and three pointers.
+*/
+inline int64_t bytes(const std::map<std::string, std::string>& m) {
+	int64_t n = sizeof(m);
+	for (auto it = m.cbegin(); it != m.cend(); ++it) {
+		n += 4 * sizeof(void*) + bytes(it->first) + bytes(it->second);
+	}
+	return n;
+}
+
+}
+
+class MemReport {
+  protected:
+	struct Phase {
+		std::string name;
+		int64_t rss;
+		int64_t peak;
+	};
+
+	std::vector<std::pair<std::string, int64_t> > entries_;
+	std::vector<Phase> phases_;
+	std::mutex mutex_;
+	// the peak is reset at every phase boundary, otherwise it is the peak since the process started
+	bool perPhase_;
+
+	static std::string human(int64_t);
+
+  public:
+	MemReport();
+
+	void add(const std::string&, int64_t);
+	void phase(const std::string&);
+	int64_t total() const;
+	void print(std::ostream&) const;
+	void save(const std::string&) const;
+};
+
+/**
+* @Function: the first phase starts now.
+*/
+MemReport::MemReport() : perPhase_(telemetry::resetPeakRss()) {}
+
+/**
+* @Function: account the bytes of a data structure, callable from any thread.
+*/
+void MemReport::add(const std::string& name, int64_t bytes) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	entries_.push_back(std::make_pair(name, bytes));
+}
+
+/**
+* @Function: record RSS and peak RSS at the end of a phase, and start the peak of the next phase.
+*/
+void MemReport::phase(const std::string& name) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	Phase p = { name, telemetry::rss(), telemetry::peakRss() };
+	phases_.push_back(p);
+	perPhase_ = perPhase_ && telemetry::resetPeakRss();
+}
+
+/**
+* @Function: bytes of all the entries.
+*/
+int64_t MemReport::total() const {
+	int64_t n = 0;
+	for (size_t i = 0; i < entries_.size(); i++) {
+		n += entries_[i].second;
+	}
+	return n;
+}
+
+/**
+* @Function: bytes as B/KB/MB/GB.
+*/
+std::string MemReport::human(int64_t bytes) {
+	static const char* const units[] = { "B", "KB", "MB", "GB", "TB" };
+	double v = bytes;
+	int32_t u = 0;
+	while (v >= 1024 && u < 4) {
+		v /= 1024;
+		u++;
+	}
+	std::ostringstream os;
+	os << std::fixed << std::setprecision(u == 0 ? 0 : 2) << v << " " << units[u];
+	return os.str();
+}
+
+/**
+* @Function: print the report.
+*/
+void MemReport::print(std::ostream& out) const {
+	out << "Memory report" << std::endl;
+	for (size_t i = 0; i < entries_.size(); i++) {
+		out << "  " << std::left << std::setw(36) << entries_[i].first << std::right
+			<< std::setw(14) << human(entries_[i].second) << std::endl;
+	}
+	out << "  " << std::left << std::setw(36) << "total" << std::right << std::setw(14) << human(total()) << std::endl;
+	for (size_t i = 0; i < phases_.size(); i++) {
+		out << "  after " << std::left << std::setw(30) << phases_[i].name << std::right
+			<< " rss " << std::setw(12) << human(phases_[i].rss)
+			<< (perPhase_ ? " phase peak rss " : " cumulative peak rss ") << std::setw(12) << human(phases_[i].peak) << std::endl;
+	}
+}
+
+/**
+* @Function: save the report as json.
+*/
+void MemReport::save(const std::string& path) const {
+	std::ofstream ofs(path);
+	if (!ofs.is_open()) {
+		throw std::invalid_argument(path + " cannot be opened for saving the memory report.");
+	}
+	ofs << "{\"bytes\":{";
+	for (size_t i = 0; i < entries_.size(); i++) {
+		ofs << (i > 0 ? "," : "") << "\"" << entries_[i].first << "\":" << entries_[i].second;
+	}
+	ofs << "},\"total_bytes\":" << total() << ",\"phases\":[";
+	for (size_t i = 0; i < phases_.size(); i++) {
+		ofs << (i > 0 ? "," : "") << "{\"phase\":\"" << phases_[i].name << "\",\"rss_bytes\":" << phases_[i].rss
+			<< (perPhase_ ? ",\"phase_peak_rss_bytes\":" : ",\"cumulative_peak_rss_bytes\":") << phases_[i].peak << "}";
+	}
+	ofs << "]}" << std::endl;
+}
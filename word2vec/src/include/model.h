@@ -15,6 +15,11 @@
 
 #include "args.h"
 #include "matrix.h"
+#include "kernels.h"
+#include "random.h"
+#include "sparsegrad.h"
+#include "profiler.h"
+#include "memreport.h"
 #include "real.h"
 
 #include <iostream>
@@ -39,22 +44,34 @@ protected:
 	// negative sampling
 	std::vector<int32_t> negatives_;
 	size_t negpos;
-	
+	// input gradients summed by row until flush()
+	bool sparse_;
+	SparseGrad accum_;
+
 	int32_t getNegative(int32_t target);
 	void initSigmoid();
 	void initLog();
 
+	void updateGeneric(const std::vector<int32_t>&, int32_t, real);
+	template <int32_t DIM>
+	void updateDim(const std::vector<int32_t>&, int32_t, real);
+
 	static const int32_t NEGATIVE_TABLE_SIZE = 10000000;
 
 public:
-	Model(std::shared_ptr<Matrix>, std::shared_ptr<Matrix>, std::shared_ptr<Args>, int32_t);
+	Model(std::shared_ptr<Matrix>, std::shared_ptr<Matrix>, std::shared_ptr<Args>, uint64_t);
 	
 	real binaryLogistic(int32_t, bool, real);
 	real negativeSampling(int32_t, real);
 
+	static int32_t specializedDim(const Args&);
+	template <int32_t DIM>
 	void update(const std::vector<int32_t>&, int32_t, real);
+	template <int32_t DIM>
 	void updatePara(const std::vector<int32_t>&, int32_t, real);
+	void update(const std::vector<int32_t>&, int32_t, real);
 	void computeHidden(const std::vector<int32_t>&, Vector&) const;
+	void flush();
 
 	void setTargetCounts(const std::vector<int64_t>&);
 	void initTableNegatives(const std::vector<int64_t>&);
@@ -62,8 +79,9 @@ public:
 	real sigmoid(real) const;
 	real log(real) const;
 	real std_log(real) const;
+	void memoryReport(MemReport&, const std::string&) const;
 
-	std::minstd_rand rng;
+	rng::engine rng;
 };
 
 constexpr int64_t SIGMOID_TABLE_SIZE = 512;
@@ -71,8 +89,9 @@ constexpr int64_t MAX_SIGMOID = 8;
 constexpr int64_t LOG_TABLE_SIZE = 512;
 
 Model::Model(std::shared_ptr<Matrix> wi, std::shared_ptr<Matrix> wo, 
-	std::shared_ptr<Args> args, int32_t seed):hidden_(args->dim), 
-	output_(wo->size(0)), grad_(args->dim), rng(seed) {
+	std::shared_ptr<Args> args, uint64_t seed):hidden_(args->dim), 
+	output_(wo->size(0)), grad_(args->dim), sparse_(args->sparseGrad),
+	accum_(args->dim), rng(seed) {
 	wi_ = wi;
 	wo_ = wo;
 	args_ = args;
@@ -87,6 +106,27 @@ Model::Model(std::shared_ptr<Matrix> wi, std::shared_ptr<Matrix> wo,
 	initLog();
 }
 
+/**
+* @Function: the dim of the specialized update of args, 0 for the generic path, the training threads
+* pick it once and instantiate their loop with it.
+*/
+int32_t Model::specializedDim(const Args& args) {
+	if (args.loss != loss_name::ns) {
+		return 0;
+	}
+	switch (args.dim) {
+	case 50:
+	case 100:
+	case 128:
+	case 200:
+	case 256:
+	case 300:
+		return args.dim;
+	default:
+		return 0;
+	}
+}
+
 /**
 * @Function: initial sigmoid().
 */
@@ -135,27 +175,145 @@ void Model::initTableNegatives(const std::vector<int64_t>& counts) {
 }
 
 /**
-* @Function: update.
+* @Function: update, DIM is the specializedDim the caller picked, 0 for the generic path.
+*/
+template <int32_t DIM>
+inline void Model::update(const std::vector<int32_t>& input, int32_t target, real lr) {
+	if (DIM == 0) {
+		updateGeneric(input, target, lr);
+	} else {
+		updateDim<DIM>(input, target, lr);
+	}
+}
+
+/**
+* @Function: update outside the training loop, the dim is dispatched on every call.
 */
 void Model::update(const std::vector<int32_t>& input, int32_t target, real lr) {
+	switch (specializedDim(*args_)) {
+	case 50:
+		update<50>(input, target, lr);
+		break;
+	case 100:
+		update<100>(input, target, lr);
+		break;
+	case 128:
+		update<128>(input, target, lr);
+		break;
+	case 200:
+		update<200>(input, target, lr);
+		break;
+	case 256:
+		update<256>(input, target, lr);
+		break;
+	case 300:
+		update<300>(input, target, lr);
+		break;
+	default:
+		update<0>(input, target, lr);
+	}
+}
+
+/**
+* @Function: update for any dim, goes through hidden_ and grad_.
+*/
+void Model::updateGeneric(const std::vector<int32_t>& input, int32_t target, real lr) {
 	assert(target >= 0);
 	assert(target < osz_);
 	if (input.size() == 0)
 		return;
-	computeHidden(input, hidden_);
+	{
+		profiler::Scope scope(profiler::COMPUTE_HIDDEN);
+		computeHidden(input, hidden_);
+	}
 	if (args_->loss == loss_name::ns) {
+		profiler::Scope scope(profiler::NEGATIVE_SAMPLING);
 		loss_ += negativeSampling(target, lr);
 	}
 	nexamples_ += 1;
+	profiler::Scope scope(profiler::SCATTER);
+	if (sparse_) {
+		for (auto it = input.cbegin(); it != input.cend(); ++it) {
+			kernels::add<0>(accum_.row(*it), grad_.data(), hsz_);
+		}
+		return;
+	}
 	for (auto it = input.cbegin(); it != input.cend(); ++it) {
 		wi_->addRow(grad_.data_, *it, 1.0);
 	}
 }
 
+/**
+* @Function: update for a fixed dim, hidden and grad stay local for the whole
+*            negative sampling loop.
+*/
+template <int32_t DIM>
+void Model::updateDim(const std::vector<int32_t>& input, int32_t target, real lr) {
+	assert(target >= 0);
+	assert(target < osz_);
+	assert(hsz_ == DIM);
+	if (input.size() == 0)
+		return;
+	real hidden[DIM];
+	real grad[DIM];
+	{
+		profiler::Scope scope(profiler::COMPUTE_HIDDEN);
+		kernels::zero<DIM>(hidden, DIM);
+		for (auto it = input.cbegin(); it != input.cend(); ++it) {
+			kernels::add<DIM>(hidden, wi_->row(*it), DIM);
+		}
+		kernels::scale<DIM>(hidden, 1.0 / input.size(), DIM);
+	}
+	kernels::zero<DIM>(grad, DIM);
+
+	real loss = 0.0;
+	{
+		profiler::Scope scope(profiler::NEGATIVE_SAMPLING);
+		for (int32_t n = 0; n <= args_->neg; n++) {
+			int32_t t = (n == 0) ? target : getNegative(target);
+			real* wo = wo_->row(t);
+			real score = kernels::dot<DIM>(wo, hidden, DIM);
+			if (std::isnan(score)) {
+				throw std::runtime_error("Encountered NaN.");
+			}
+			score = sigmoid(score);
+			real alpha = lr * (real(n == 0) - score);
+			kernels::axpy<DIM>(grad, alpha, wo, DIM);
+			kernels::axpy<DIM>(wo, alpha, hidden, DIM);
+			wo_->markDirty(t);
+			loss -= (n == 0) ? log(score) : log(1.0 - score);
+		}
+	}
+	loss_ += loss;
+	nexamples_ += 1;
+	profiler::Scope scope(profiler::SCATTER);
+	if (sparse_) {
+		for (auto it = input.cbegin(); it != input.cend(); ++it) {
+			kernels::add<DIM>(accum_.row(*it), grad, DIM);
+		}
+		return;
+	}
+	for (auto it = input.cbegin(); it != input.cend(); ++it) {
+		kernels::add<DIM>(wi_->row(*it), grad, DIM);
+		wi_->markDirty(*it);
+	}
+}
+
+/**
+* @Function: write the accumulated input gradients, one addRow per row.
+*/
+void Model::flush() {
+	if (sparse_) {
+		profiler::Scope scope(profiler::SCATTER);
+		accum_.flush(*wi_);
+	}
+}
+
+template <int32_t DIM>
 void Model::updatePara(const std::vector<int32_t>& input, int32_t target, real lr) {
 	vector<int32_t> source;
 	source.push_back(input[0]);
-	update(source, target, lr);
+	update<DIM>(source, target, lr);
 
 	int input_size = input.size();
 	if (input_size > 1) {
@@ -163,7 +321,7 @@ void Model::updatePara(const std::vector<int32_t>& input, int32_t target, real l
 		for (int i = 1; i < input_size; i++) {
 			feature.push_back(input[i]);
 		}
-		update(feature, target, lr);
+		update<DIM>(feature, target, lr);
 		nexamples_ -= 1;
 	}
 }
@@ -223,6 +381,21 @@ int32_t Model::getNegative(int32_t target) {
 	return negative;
 }
 
+/**
+* @Function: account the tables and vectors of the model.
+*/
+void Model::memoryReport(MemReport& report, const std::string& prefix) const {
+	report.add(prefix + ".negatives_", memreport::bytes(negatives_));
+	report.add(prefix + ".t_sigmoid_", memreport::bytes(t_sigmoid_));
+	report.add(prefix + ".t_log_", memreport::bytes(t_log_));
+	report.add(prefix + ".hidden_", hidden_.memoryUsage());
+	report.add(prefix + ".output_", output_.memoryUsage());
+	report.add(prefix + ".grad_", grad_.memoryUsage());
+	if (sparse_) {
+		report.add(prefix + ".accum_", accum_.memoryUsage());
+	}
+}
+
 /**
 * @Function: getLoss().
 */
@@ -0,0 +1,386 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: neighbors.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: exact top-k cosine neighbours over trained vectors, queries batched into blocked products.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "matrix.h"
+#include "binmodel.h"
+#include "kernels.h"
+#include "real.h"
+#include "utils.h"
+
+namespace neighbors {
+
+// rows scored against a block of queries while they stay in the cache
+static const int64_t ROW_BLOCK = 256;
+static const int64_t QUERY_BLOCK = 16;
+
+struct Neighbor {
+	real score;
+	int64_t id;
+};
+
+/**
+* @Function: higher score first, the lower id on ties so results do not depend on the threads.
+*/
+inline bool better(const Neighbor& a, const Neighbor& b) {
+	return a.score > b.score || (a.score == b.score && a.id < b.id);
+}
+
+/**
+* @Function: keep n in a min-heap of at most k with the worst neighbour on top, unless it is not better
+* than all k or its id is in exclude.
+*/
+inline void offer(std::vector<Neighbor>& heap, int32_t k, const Neighbor& n, const std::vector<int64_t>& exclude) {
+	if (int32_t(heap.size()) == k && !better(n, heap.front())) {
+		return;
+	}
+	if (!exclude.empty() && std::find(exclude.begin(), exclude.end(), n.id) != exclude.end()) {
+		return;
+	}
+	heap.push_back(n);
+	std::push_heap(heap.begin(), heap.end(), better);
+	if (int32_t(heap.size()) > k) {
+		std::pop_heap(heap.begin(), heap.end(), better);
+		heap.pop_back();
+	}
+}
+
+/**
+* @Function: the k best of each query over the heaps of all threads, best first.
+*/
+inline void merge(const std::vector<std::vector<std::vector<Neighbor>>>& heaps, int64_t nq, int32_t k,
+		std::vector<std::vector<Neighbor>>& results) {
+	results.assign(nq, std::vector<Neighbor>());
+	for (int64_t q = 0; q < nq; q++) {
+		for (size_t t = 0; t < heaps.size(); t++) {
+			results[q].insert(results[q].end(), heaps[t][q].begin(), heaps[t][q].end());
+		}
+		std::sort(results[q].begin(), results[q].end(), better);
+		if (int32_t(results[q].size()) > k) {
+			results[q].resize(k);
+		}
+	}
+}
+
+/**
+* @Function: binmodel section of a name, words (.source), features (.feature) or targets (.target).
+*/
+inline int32_t sectionOf(const std::string& name) {
+	if (name == "words" || name == "source") {
+		return binmodel::WORDS;
+	}
+	if (name == "features" || name == "feature") {
+		return binmodel::FEATURES;
+	}
+	if (name == "targets" || name == "target") {
+		return binmodel::TARGETS;
+	}
+	throw std::invalid_argument("unknown section " + name + ", expected words, features or targets.");
+}
+
+/**
+* @Function: read a binary model section or a text file of "name v1 .. vdim" lines, the rows are parsed in parallel.
+*/
+std::shared_ptr<Matrix> load(const std::string& path, const std::string& section,
+		std::vector<std::string>& names, int32_t threads) {
+	threads = std::max(threads, 1);
+	uint32_t magic = 0;
+	// shm:<name> is the live model of a training run, always a binary model
+	const bool shm = path.compare(0, 4, "shm:") == 0;
+	if (!shm) {
+		std::ifstream ifs(path, std::ios::binary);
+		if (!ifs.is_open()) {
+			throw std::invalid_argument(path + " cannot be opened for loading vectors.");
+		}
+		ifs.read((char*)&magic, sizeof(magic));
+		ifs.close();
+	}
+	names.clear();
+	if (shm || magic == binmodel::MAGIC) {
+		BinaryModel model(path);
+		const int32_t s = sectionOf(section);
+		const int64_t n = model.size(s);
+		const int64_t dim = model.dim();
+		auto m = std::make_shared<Matrix>(n, dim);
+		names.resize(n);
+		utils::parallel(threads, [&](int32_t t) {
+			for (int64_t i = n * t / threads; i < n * (t + 1) / threads; i++) {
+				names[i] = model.string(s, i);
+				std::memcpy(m->row(i), model.vector(s, i), dim * sizeof(real));
+			}
+		});
+		return m;
+	}
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		throw std::invalid_argument(path + " cannot be opened for loading vectors.");
+	}
+	const size_t size = st.st_size;
+	void* p = size == 0 ? MAP_FAILED : mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED) {
+		throw std::invalid_argument(path + " is empty or cannot be mapped.");
+	}
+	std::shared_ptr<char> mapped((char*)p, [size](char* q) { munmap(q, size); });
+	const char* data = mapped.get();
+	const char* end = data + size;
+
+	std::vector<const char*> lines;
+	for (const char* q = data; q < end; ) {
+		const char* eol = (const char*)std::memchr(q, '\n', end - q);
+		if (eol == nullptr) {
+			eol = end;
+		}
+		if (eol > q && !(eol == q + 1 && *q == '\r')) {
+			lines.push_back(q);
+		}
+		q = eol + 1;
+	}
+	// the dim is the number of values of the first line, a "count dim" header is skipped
+	auto fields = [&](const char* q) {
+		int64_t n = 0;
+		while (q < end && *q != '\n') {
+			while (q < end && (*q == ' ' || *q == '\t' || *q == '\r')) {
+				q++;
+			}
+			if (q < end && *q != '\n') {
+				n++;
+			}
+			while (q < end && *q != ' ' && *q != '\t' && *q != '\r' && *q != '\n') {
+				q++;
+			}
+		}
+		return n;
+	};
+	size_t first = 0;
+	if (lines.size() > 1 && fields(lines[0]) == 2 && fields(lines[1]) != 2) {
+		first = 1;
+	}
+	const int64_t n = lines.size() - first;
+	const int64_t dim = n > 0 ? fields(lines[first]) - 1 : 0;
+	if (dim <= 0) {
+		throw std::invalid_argument(path + " has no vectors.");
+	}
+	auto m = std::make_shared<Matrix>(n, dim);
+	names.resize(n);
+	utils::parallel(threads, [&](int32_t t) {
+		std::string line;
+		for (int64_t i = n * t / threads; i < n * (t + 1) / threads; i++) {
+			const char* b = lines[first + i];
+			const char* e = (const char*)std::memchr(b, '\n', end - b);
+			// strtof needs a terminated copy
+			line.assign(b, e == nullptr ? end : e);
+			const char* q = line.c_str();
+			const char* name = q;
+			while (*q != '\0' && *q != ' ' && *q != '\t') {
+				q++;
+			}
+			names[i].assign(name, q);
+			real* row = m->row(i);
+			int64_t j = 0;
+			while (true) {
+				char* stop;
+				real v = std::strtof(q, &stop);
+				if (stop == q) {
+					break;
+				}
+				if (j >= dim) {
+					j++;
+					break;
+				}
+				row[j++] = v;
+				q = stop;
+			}
+			if (j != dim) {
+				throw std::invalid_argument(path + ": the vector of " + names[i] + " does not have dim " + std::to_string(dim));
+			}
+		}
+	});
+	return m;
+}
+
+}
+
+/**
+* @Function: exact cosine search, the rows are normalized once and a batch of queries is
+* answered in one pass over the rows, each thread keeps a top-k heap per query for its rows.
+*/
+class NearestNeighbors {
+  protected:
+	std::shared_ptr<Matrix> vectors_;
+	std::vector<std::string> names_;
+	std::unordered_map<std::string, int64_t> ids_;
+	int32_t threads_;
+
+	void scan(const Matrix&, int64_t, int64_t, int32_t, const std::vector<std::vector<int64_t>>&,
+		std::vector<std::vector<neighbors::Neighbor>>&) const;
+
+  public:
+	NearestNeighbors(std::shared_ptr<Matrix>, const std::vector<std::string>&, int32_t);
+
+	inline int64_t size() const {
+		return vectors_->rows();
+	}
+	inline int64_t dim() const {
+		return vectors_->cols();
+	}
+	inline const std::string& name(int64_t id) const {
+		return names_[id];
+	}
+	inline const Matrix& vectors() const {
+		return *vectors_;
+	}
+	int64_t find(const std::string&) const;
+	static void normalize(Matrix&, int32_t);
+	void search(const Matrix&, int32_t, const std::vector<std::vector<int64_t>>&,
+		std::vector<std::vector<neighbors::Neighbor>>&) const;
+	void nearest(const std::vector<std::string>&, int32_t, std::vector<std::vector<neighbors::Neighbor>>&) const;
+	template <class Index>
+	void nearest(const Index&, const std::vector<std::string>&, int32_t, std::vector<std::vector<neighbors::Neighbor>>&) const;
+};
+
+/**
+* @Function: take the vectors, normalized in place, and their names.
+*/
+NearestNeighbors::NearestNeighbors(std::shared_ptr<Matrix> vectors, const std::vector<std::string>& names,
+		int32_t threads) : vectors_(vectors), names_(names), threads_(std::max(threads, 1)) {
+	if (int64_t(names_.size()) != vectors_->rows()) {
+		throw std::invalid_argument("the names do not match the rows of the vectors.");
+	}
+	normalize(*vectors_, threads_);
+	ids_.reserve(names_.size());
+	for (size_t i = 0; i < names_.size(); i++) {
+		ids_.emplace(names_[i], i);
+	}
+}
+
+/**
+* @Function: row of a name, -1 if unknown.
+*/
+int64_t NearestNeighbors::find(const std::string& name) const {
+	auto it = ids_.find(name);
+	return it == ids_.end() ? -1 : it->second;
+}
+
+/**
+* @Function: scale the rows to unit length, zero rows are left as they are.
+*/
+void NearestNeighbors::normalize(Matrix& m, int32_t threads) {
+	utils::parallel(threads, [&](int32_t t) {
+		for (int64_t i = m.rows() * t / threads; i < m.rows() * (t + 1) / threads; i++) {
+			real norm = m.l2NormRow(i);
+			if (norm > 0) {
+				kernels::scale<0>(m.row(i), real(1.0) / norm, m.cols());
+			}
+		}
+	});
+}
+
+/**
+* @Function: top-k of the queries among rows [ib, ie), heaps are min-heaps with the worst neighbour on top.
+*/
+void NearestNeighbors::scan(const Matrix& queries, int64_t ib, int64_t ie, int32_t k,
+		const std::vector<std::vector<int64_t>>& exclude, std::vector<std::vector<neighbors::Neighbor>>& heaps) const {
+	const int64_t nq = queries.rows();
+	const int64_t dim = vectors_->cols();
+	const std::vector<int64_t> none;
+	heaps.assign(nq, std::vector<neighbors::Neighbor>());
+	for (int64_t rb = ib; rb < ie; rb += neighbors::ROW_BLOCK) {
+		const int64_t re = std::min(ie, rb + neighbors::ROW_BLOCK);
+		for (int64_t qb = 0; qb < nq; qb += neighbors::QUERY_BLOCK) {
+			const int64_t qe = std::min(nq, qb + neighbors::QUERY_BLOCK);
+			for (int64_t q = qb; q < qe; q++) {
+				const real* query = queries.row(q);
+				std::vector<neighbors::Neighbor>& heap = heaps[q];
+				for (int64_t i = rb; i < re; i++) {
+					neighbors::Neighbor n = { kernels::dot<0>(query, vectors_->row(i), dim), i };
+					neighbors::offer(heap, k, n, exclude.empty() ? none : exclude[q]);
+				}
+			}
+		}
+	}
+}
+
+/**
+* @Function: the k rows closest to each query row, best first, exclude is empty or holds the rows
+* to skip for each query, the threads split the rows and their heaps are merged at the end.
+*/
+void NearestNeighbors::search(const Matrix& queries, int32_t k, const std::vector<std::vector<int64_t>>& exclude,
+		std::vector<std::vector<neighbors::Neighbor>>& results) const {
+	if (queries.cols() != dim()) {
+		throw std::invalid_argument("the queries do not have dim " + std::to_string(dim()));
+	}
+	if (k <= 0) {
+		results.assign(queries.rows(), std::vector<neighbors::Neighbor>());
+		return;
+	}
+	Matrix unit(queries);
+	normalize(unit, 1);
+	const int64_t n = size();
+	const int32_t threads = int32_t(std::max<int64_t>(1, std::min<int64_t>(threads_, n / neighbors::ROW_BLOCK)));
+	std::vector<std::vector<std::vector<neighbors::Neighbor>>> heaps(threads);
+	utils::parallel(threads, [&](int32_t t) {
+		scan(unit, n * t / threads, n * (t + 1) / threads, k, exclude, heaps[t]);
+	});
+	neighbors::merge(heaps, unit.rows(), k, results);
+}
+
+/**
+* @Function: neighbours of known names, the name itself is skipped, unknown names get no neighbours.
+*/
+void NearestNeighbors::nearest(const std::vector<std::string>& names, int32_t k,
+		std::vector<std::vector<neighbors::Neighbor>>& results) const {
+	nearest(*this, names, k, results);
+}
+
+/**
+* @Function: same as nearest, the queries are answered by index, any class with the search of NearestNeighbors.
+*/
+template <class Index>
+void NearestNeighbors::nearest(const Index& index, const std::vector<std::string>& names, int32_t k,
+		std::vector<std::vector<neighbors::Neighbor>>& results) const {
+	std::vector<int64_t> known;
+	for (size_t i = 0; i < names.size(); i++) {
+		int64_t id = find(names[i]);
+		if (id >= 0) {
+			known.push_back(i);
+		}
+	}
+	Matrix queries(known.size(), dim());
+	std::vector<std::vector<int64_t>> exclude(known.size());
+	for (size_t i = 0; i < known.size(); i++) {
+		int64_t id = find(names[known[i]]);
+		std::memcpy(queries.row(i), vectors_->row(id), dim() * sizeof(real));
+		exclude[i].push_back(id);
+	}
+	std::vector<std::vector<neighbors::Neighbor>> found;
+	index.search(queries, k, exclude, found);
+	results.assign(names.size(), std::vector<neighbors::Neighbor>());
+	for (size_t i = 0; i < known.size(); i++) {
+		results[known[i]].swap(found[i]);
+	}
+}
@@ -0,0 +1,274 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: perfcounters.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: per-thread hardware performance counters through perf_event_open.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+
+#include "utils.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+namespace perf {
+
+enum counter : int32_t {
+	CYCLES = 0,
+	INSTRUCTIONS,
+	LLC_MISSES,
+	DTLB_MISSES,
+	// cache-line transfers have no generic event, the raw event code is given by -perfRaw
+	TRANSFERS,
+	NCOUNTERS
+};
+
+static const char* const COUNTER_NAMES[NCOUNTERS] = {
+	"cyc", "ins", "LLC", "dTLB", "xfer"
+};
+
+// flushes of a training thread between two reads of its counters
+static const int64_t READ_EVERY = 64;
+
+}
+
+/**
+* @Function: the counter group of the calling thread, all the counters are read with one read of the leader.
+*/
+class PerfCounters {
+  protected:
+	int fds_[perf::NCOUNTERS];
+	int leader_;
+	// counter of each value of a group read, in the order the counters joined the group
+	int32_t order_[perf::NCOUNTERS];
+	int32_t members_;
+	int64_t calls_;
+
+	void join(int32_t, uint32_t, uint64_t);
+
+	static int open(uint32_t, uint64_t, int);
+
+  public:
+	PerfCounters(uint64_t);
+	~PerfCounters();
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	inline bool ok() const {
+		return leader_ >= 0;
+	}
+	bool has(int32_t) const;
+	void read(uint64_t*) const;
+
+	/**
+	* @Function: whether the counters are due to be read, true once every perf::READ_EVERY calls.
+	*/
+	inline bool due() {
+		return ++calls_ % perf::READ_EVERY == 0;
+	}
+};
+
+/**
+* @Function: open one counter of the calling thread, -1 if unavailable.
+*/
+int PerfCounters::open(uint32_t type, uint64_t config, int group) {
+#ifdef __linux__
+	struct perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = group < 0 ? 1 : 0;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return int(syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+#else
+	return -1;
+#endif
+}
+
+/**
+* @Function: add a counter to the group of the leader, skipped if unavailable.
+*/
+void PerfCounters::join(int32_t c, uint32_t type, uint64_t config) {
+	fds_[c] = open(type, config, leader_);
+	if (fds_[c] >= 0) {
+		order_[members_++] = c;
+	}
+}
+
+/**
+* @Function: open the counters of the calling thread, raw is 0 or a raw event code.
+*/
+PerfCounters::PerfCounters(uint64_t raw) : members_(0), calls_(0) {
+	for (int32_t i = 0; i < perf::NCOUNTERS; i++) {
+		fds_[i] = -1;
+		order_[i] = -1;
+	}
+#ifdef __linux__
+	leader_ = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+	if (leader_ < 0) {
+		return;
+	}
+	fds_[perf::CYCLES] = leader_;
+	order_[members_++] = perf::CYCLES;
+	join(perf::INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+	join(perf::LLC_MISSES, PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL
+		| (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+	join(perf::DTLB_MISSES, PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB
+		| (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+	if (raw != 0) {
+		join(perf::TRANSFERS, PERF_TYPE_RAW, raw);
+	}
+	ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+	leader_ = -1;
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+	for (int32_t i = 0; i < perf::NCOUNTERS; i++) {
+		if (fds_[i] >= 0) {
+			close(fds_[i]);
+		}
+	}
+#endif
+}
+
+/**
+* @Function: whether a counter could be opened.
+*/
+bool PerfCounters::has(int32_t c) const {
+	return fds_[c] >= 0;
+}
+
+/**
+* @Function: current values, one read of the whole group, scaled up when the group was multiplexed.
+*/
+void PerfCounters::read(uint64_t* values) const {
+	for (int32_t i = 0; i < perf::NCOUNTERS; i++) {
+		values[i] = 0;
+	}
+#ifdef __linux__
+	if (leader_ < 0) {
+		return;
+	}
+	// nr, time enabled, time running, then one value per member
+	uint64_t buf[3 + perf::NCOUNTERS];
+	ssize_t n = ::read(leader_, buf, sizeof(buf));
+	if (n < ssize_t(3 * sizeof(uint64_t)) || buf[0] > uint64_t(members_)
+			|| n < ssize_t((3 + buf[0]) * sizeof(uint64_t))) {
+		return;
+	}
+	const double scale = buf[2] > 0 && buf[2] < buf[1] ? double(buf[1]) / buf[2] : 1.0;
+	for (uint64_t j = 0; j < buf[0]; j++) {
+		values[order_[j]] = uint64_t(double(buf[3 + j]) * scale);
+	}
+#endif
+}
+
+/**
+* @Function: counters of all training threads, each slot written by its thread.
+*/
+class PerfReport {
+  protected:
+	struct alignas(64) Slot {
+		std::atomic<uint64_t> values[perf::NCOUNTERS];
+	};
+
+	utils::AlignedArray<Slot> slots_;
+	int32_t nthreads_;
+	std::atomic<uint32_t> available_;
+
+  public:
+	explicit PerfReport(int32_t);
+
+	void store(int32_t, const PerfCounters&);
+	bool any() const;
+	void print(int64_t, std::ostream&) const;
+};
+
+/**
+* @Function: initial PerfReport class argument.
+*/
+PerfReport::PerfReport(int32_t nthreads) : slots_(utils::alignedArray<Slot>(nthreads)), nthreads_(nthreads), available_(0) {
+	for (int32_t t = 0; t < nthreads; t++) {
+		for (int32_t i = 0; i < perf::NCOUNTERS; i++) {
+			slots_[t].values[i] = 0;
+		}
+	}
+}
+
+/**
+* @Function: publish the counters of a thread.
+*/
+void PerfReport::store(int32_t threadId, const PerfCounters& counters) {
+	if (!counters.ok()) {
+		return;
+	}
+	uint64_t values[perf::NCOUNTERS];
+	counters.read(values);
+	uint32_t mask = 0;
+	for (int32_t i = 0; i < perf::NCOUNTERS; i++) {
+		slots_[threadId].values[i].store(values[i], std::memory_order_relaxed);
+		if (counters.has(i)) {
+			mask |= 1u << i;
+		}
+	}
+	available_.fetch_or(mask, std::memory_order_relaxed);
+}
+
+/**
+* @Function: whether any thread could open its counters.
+*/
+bool PerfReport::any() const {
+	return available_.load(std::memory_order_relaxed) != 0;
+}
+
+/**
+* @Function: counters of all threads per million tokens.
+*/
+void PerfReport::print(int64_t tokens, std::ostream& out) const {
+	if (!any() || tokens <= 0) {
+		return;
+	}
+	uint32_t mask = available_.load(std::memory_order_relaxed);
+	double sums[perf::NCOUNTERS] = { 0 };
+	for (int32_t t = 0; t < nthreads_; t++) {
+		for (int32_t i = 0; i < perf::NCOUNTERS; i++) {
+			sums[i] += slots_[t].values[i].load(std::memory_order_relaxed);
+		}
+	}
+	double mtok = tokens / 1e6;
+	std::ios_base::fmtflags flags = out.flags();
+	out.unsetf(std::ios_base::floatfield);
+	out << std::setprecision(3);
+	if ((mask & (1u << perf::INSTRUCTIONS)) && sums[perf::CYCLES] > 0) {
+		out << " IPC: " << sums[perf::INSTRUCTIONS] / sums[perf::CYCLES];
+	}
+	for (int32_t i = 0; i < perf::NCOUNTERS; i++) {
+		if (mask & (1u << i)) {
+			out << " " << perf::COUNTER_NAMES[i] << "/Mtok: " << sums[i] / mtok;
+		}
+	}
+	out.flags(flags);
+}
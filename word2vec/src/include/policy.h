@@ -0,0 +1,126 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: policy.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: input composition and update policies of the training loop.
+*/
+
+#pragma once
+
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+#include "args.h"
+#include "dictionary.h"
+#include "model.h"
+#include "random.h"
+#include "real.h"
+
+/*
+  Every training mode is one (input, update) pair, FastText::trainLoop is
+  instantiated once per pair and per specialized dim of Model::specializedDim.
+  An input policy reads a line and turns it into (input ids, target) pairs,
+  an update policy applies one pair to the model.
+*/
+namespace policy {
+
+/**
+* @Function: the word and its features are updated as one input.
+*/
+struct JointUpdate {
+	template <int32_t DIM>
+	static inline void apply(Model& model, const std::vector<int32_t>& input, int32_t target, real lr) {
+		model.template update<DIM>(input, target, lr);
+	}
+};
+
+/**
+* @Function: the word and its features are updated as two inputs.
+*/
+struct SplitUpdate {
+	template <int32_t DIM>
+	static inline void apply(Model& model, const std::vector<int32_t>& input, int32_t target, real lr) {
+		model.template updatePara<DIM>(input, target, lr);
+	}
+};
+
+/**
+* @Function: plain lines of words.
+*/
+struct WordLine {
+	static inline int32_t getLine(const Dictionary& dict, std::istream& in,
+		std::vector<std::vector<int32_t> >& sourceType, std::vector<std::vector<int32_t> >& source,
+		std::vector<int32_t>& target, rng::engine& rng) {
+		return dict.getLine(in, sourceType, source, target, rng);
+	}
+};
+
+/**
+* @Function: lines of word_radical tokens.
+*/
+struct RadicalLine {
+	static inline int32_t getLine(const Dictionary& dict, std::istream& in,
+		std::vector<std::vector<int32_t> >& sourceType, std::vector<std::vector<int32_t> >& source,
+		std::vector<int32_t>& target, rng::engine& rng) {
+		return dict.getLine_zh(in, sourceType, source, target, rng);
+	}
+};
+
+/**
+* @Function: the center word input predicts every word of its window.
+*/
+template <class Line>
+struct ContextInput : Line {
+	std::vector<int32_t> boundaries;
+	template <class Update, int32_t DIM>
+	inline void train(Model& model, real lr, int32_t ws, const std::vector<std::vector<int32_t> >& source,
+		const std::vector<int32_t>& target) {
+		const int32_t length = target.size();
+		boundaries.resize(length);
+		rng::fillRange(model.rng, boundaries.data(), length, 1, ws);
+		for (int32_t w = 0; w < length; w++) {
+			int32_t boundary = boundaries[w];
+			const std::vector<int32_t>& ngrams = source[w];
+			int32_t begin = std::max(w - boundary, 0);
+			int32_t end = std::min(w + boundary, length - 1);
+			for (int32_t c = begin; c <= end; c++) {
+				if (c != w) {
+					Update::template apply<DIM>(model, ngrams, target[c], lr);
+				}
+			}
+		}
+	}
+};
+
+/**
+* @Function: the bag of window inputs predicts the center word.
+*/
+template <class Line>
+struct BagInput : Line {
+	std::vector<int32_t> buffer;
+	std::vector<int32_t> boundaries;
+
+	template <class Update, int32_t DIM>
+	inline void train(Model& model, real lr, int32_t ws, const std::vector<std::vector<int32_t> >& source,
+		const std::vector<int32_t>& target) {
+		const int32_t length = target.size();
+		boundaries.resize(length);
+		rng::fillRange(model.rng, boundaries.data(), length, 1, ws);
+		for (int32_t w = 0; w < length; w++) {
+			int32_t boundary = boundaries[w];
+			int32_t begin = std::max(w - boundary, 0);
+			int32_t end = std::min(w + boundary, length - 1);
+			buffer.clear();
+			for (int32_t c = begin; c <= end; c++) {
+				if (c != w) {
+					buffer.insert(buffer.end(), source[c].cbegin(), source[c].cend());
+				}
+			}
+			Update::template apply<DIM>(model, buffer, target[w], lr);
+		}
+	}
+};
+
+}
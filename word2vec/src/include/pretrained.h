@@ -0,0 +1,242 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: pretrained.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: parallel loading of pretrained text or binary vectors into the input matrix.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dictionary.h"
+#include "matrix.h"
+#include "binmodel.h"
+#include "real.h"
+#include "utils.h"
+
+namespace pretrained {
+
+/**
+* @Function: row of a name of a section in the input matrix, words first and then features, -1 if unknown,
+* a feature that is spelled like a word still goes to its own row.
+*/
+inline int64_t rowOf(const Dictionary& dict, int32_t section, const std::string& name) {
+	if (section == binmodel::WORDS) {
+		return dict.getWordId(name);
+	}
+	int32_t id = dict.getFeatureId(name);
+	return id >= 0 ? int64_t(dict.nwords()) + id : -1;
+}
+
+/**
+* @Function: section of a text file, the features for a .feature export (or one of its shards .feature.N),
+* the words otherwise.
+*/
+inline int32_t sectionOf(const std::string& path) {
+	std::string base = path;
+	size_t dot = base.find_last_of('.');
+	if (dot != std::string::npos && dot + 1 < base.size()
+			&& base.find_first_not_of("0123456789", dot + 1) == std::string::npos) {
+		base = base.substr(0, dot);
+	}
+	const std::string suffix = ".feature";
+	if (base.size() >= suffix.size() && base.compare(base.size() - suffix.size(), suffix.size(), suffix) == 0) {
+		return binmodel::FEATURES;
+	}
+	return binmodel::WORDS;
+}
+
+/**
+* @Function: parse the lines of [begin, end) that start in it, one "name v1 .. vdim" per line.
+*/
+void parseText(const char* begin, const char* end, const char* fileEnd, const std::string& path,
+		const Dictionary& dict, int32_t section, Matrix& input, std::vector<char>& loaded) {
+	const int64_t dim = input.cols();
+	std::vector<real> values(dim);
+	std::string last;
+	const char* p = begin;
+	while (p < end) {
+		const char* eol = (const char*)std::memchr(p, '\n', fileEnd - p);
+		const char* next = eol;
+		if (eol != nullptr) {
+			next = eol + 1;
+		} else {
+			// strtof needs a terminator after the last line
+			last.assign(p, fileEnd);
+			next = fileEnd;
+			p = last.c_str();
+			eol = p + last.size();
+		}
+		const char* q = p;
+		while (q < eol && *q != ' ' && *q != '\t') {
+			q++;
+		}
+		std::string name(p, q);
+		int64_t row = name.empty() ? -1 : rowOf(dict, section, name);
+		if (row >= 0) {
+			int64_t j = 0;
+			while (true) {
+				while (q < eol && (*q == ' ' || *q == '\t' || *q == '\r')) {
+					q++;
+				}
+				if (q >= eol) {
+					break;
+				}
+				char* stop;
+				real v = std::strtof(q, &stop);
+				if (stop == q || j >= dim) {
+					throw std::invalid_argument(path + ": the vector of " + name + " does not have dim " + std::to_string(dim));
+				}
+				values[j++] = v;
+				q = stop;
+			}
+			if (j != dim) {
+				throw std::invalid_argument(path + ": the vector of " + name + " does not have dim " + std::to_string(dim));
+			}
+			std::memcpy(input.row(row), values.data(), dim * sizeof(real));
+			loaded[row] = 1;
+		}
+		p = next;
+	}
+}
+
+/**
+* @Function: load a text file into the rows of its section, each thread parses the lines starting in its share of the bytes.
+*/
+void loadText(const std::string& path, const Dictionary& dict, Matrix& input,
+		std::vector<char>& loaded, int32_t threads) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::invalid_argument(path + " cannot be opened for loading pretrained vectors.");
+	}
+	struct stat st;
+	fstat(fd, &st);
+	size_t size = st.st_size;
+	if (size == 0) {
+		::close(fd);
+		return;
+	}
+	void* m = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (m == MAP_FAILED) {
+		throw std::invalid_argument(path + " cannot be mapped.");
+	}
+	const char* data = (const char*)m;
+	const char* end = data + size;
+	const char* start = data;
+
+	// an optional "count dim" header line as written by the original word2vec
+	const char* eol = (const char*)std::memchr(data, '\n', size);
+	std::string first(data, eol == nullptr ? end : eol);
+	char* stop;
+	long long rows = std::strtoll(first.c_str(), &stop, 10);
+	if (stop != first.c_str() && rows >= 0) {
+		char* stop2;
+		long long dim = std::strtoll(stop, &stop2, 10);
+		while (*stop2 == ' ' || *stop2 == '\r') {
+			stop2++;
+		}
+		if (stop2 != stop && *stop2 == '\0') {
+			if (dim != input.cols()) {
+				munmap(m, size);
+				throw std::invalid_argument(path + " has dim " + std::to_string(dim)
+					+ " but -dim is " + std::to_string(input.cols()));
+			}
+			start = eol == nullptr ? end : eol + 1;
+		}
+	}
+
+	const int32_t section = sectionOf(path);
+	const size_t share = (end - start + threads - 1) / threads;
+	try {
+		utils::parallel(threads, [&](int32_t t) {
+			const char* b = std::min(end, start + t * share);
+			const char* e = std::min(end, b + share);
+			// a thread parses the lines starting in [b, e), a line cut at b belongs to the previous thread
+			if (b > start && b[-1] != '\n') {
+				const char* nl = (const char*)std::memchr(b, '\n', end - b);
+				b = nl == nullptr ? end : nl + 1;
+			}
+			if (b < e) {
+				parseText(b, e, end, path, dict, section, input, loaded);
+			}
+		});
+	} catch (...) {
+		munmap(m, size);
+		throw;
+	}
+	munmap(m, size);
+}
+
+/**
+* @Function: load the words and features of a binary model, each section into its own rows.
+*/
+void loadBinary(const std::string& path, const Dictionary& dict, Matrix& input,
+		std::vector<char>& loaded, int32_t threads) {
+	BinaryModel model(path);
+	if (model.dim() != input.cols()) {
+		throw std::invalid_argument(path + " has dim " + std::to_string(model.dim())
+			+ " but -dim is " + std::to_string(input.cols()));
+	}
+	const int32_t sections[] = { binmodel::WORDS, binmodel::FEATURES };
+	for (int32_t s : sections) {
+		const int64_t n = model.size(s);
+		utils::parallel(threads, [&](int32_t t) {
+			for (int64_t i = n * t / threads; i < n * (t + 1) / threads; i++) {
+				int64_t row = rowOf(dict, s, model.string(s, i));
+				if (row >= 0) {
+					std::memcpy(input.row(row), model.vector(s, i), input.cols() * sizeof(real));
+					loaded[row] = 1;
+				}
+			}
+		});
+	}
+}
+
+/**
+* @Function: load a comma-separated list of files into the rows of the known words and features, returns the rows loaded.
+*/
+int64_t load(const std::string& paths, const Dictionary& dict, Matrix& input, int32_t threads) {
+	threads = std::max(threads, 1);
+	std::vector<char> loaded(input.rows(), 0);
+	size_t pos = 0;
+	while (pos <= paths.size()) {
+		size_t comma = paths.find(',', pos);
+		if (comma == std::string::npos) {
+			comma = paths.size();
+		}
+		std::string path = paths.substr(pos, comma - pos);
+		pos = comma + 1;
+		if (path == "") {
+			continue;
+		}
+		uint32_t magic = 0;
+		std::ifstream ifs(path, std::ios::binary);
+		if (!ifs.is_open()) {
+			throw std::invalid_argument(path + " cannot be opened for loading pretrained vectors.");
+		}
+		ifs.read((char*)&magic, sizeof(magic));
+		ifs.close();
+		if (magic == binmodel::MAGIC) {
+			loadBinary(path, dict, input, loaded, threads);
+		} else {
+			loadText(path, dict, input, loaded, threads);
+		}
+	}
+	return std::count(loaded.begin(), loaded.end(), 1);
+}
+
+}
@@ -0,0 +1,233 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: profiler.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: sampled hot-path phase profiler of the training threads.
+*/
+
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <cstdint>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "utils.h"
+
+namespace profiler {
+
+enum phase : int32_t {
+	READ_WORD = 0,
+	LOOKUP,
+	SUBSAMPLE,
+	COMPUTE_HIDDEN,
+	NEGATIVE_SAMPLING,
+	SCATTER,
+	NPHASES
+};
+
+static const char* const PHASE_NAMES[NPHASES] = {
+	"readWord", "lookup", "subsample", "computeHidden", "negativeSampling", "scatter"
+};
+
+/**
+* @Function: time stamp counter, steady clock nanoseconds without one.
+*/
+inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct Event {
+	int32_t phase;
+	uint64_t begin;
+	uint64_t end;
+};
+
+// owned by one thread, its counters start on their own cache line and the trace events on the next one
+struct alignas(64) ThreadProfile {
+	uint64_t ticks[NPHASES];
+	uint64_t calls[NPHASES];
+	int64_t lines;
+	int64_t sampledLines;
+	alignas(64) std::vector<Event> events;
+	size_t maxEvents;
+
+	ThreadProfile() : lines(0), sampledLines(0), maxEvents(0) {
+		for (int32_t i = 0; i < NPHASES; i++) {
+			ticks[i] = 0;
+			calls[i] = 0;
+		}
+	}
+
+	inline void add(int32_t p, uint64_t begin, uint64_t end) {
+		ticks[p] += end - begin;
+		calls[p]++;
+		if (events.size() < maxEvents) {
+			Event e = { p, begin, end };
+			events.push_back(e);
+		}
+	}
+};
+
+// profile of the running thread, only set while a sampled line is trained
+thread_local ThreadProfile* current = nullptr;
+
+/**
+* @Function: times the enclosing block when the line is sampled.
+*/
+class Scope {
+  protected:
+	ThreadProfile* prof_;
+	int32_t phase_;
+	uint64_t begin_;
+
+  public:
+	explicit inline Scope(int32_t p) : prof_(current), phase_(p), begin_(0) {
+		if (prof_) {
+			begin_ = ticks();
+		}
+	}
+	inline ~Scope() {
+		if (prof_) {
+			prof_->add(phase_, begin_, ticks());
+		}
+	}
+	Scope(const Scope&) = delete;
+	Scope& operator=(const Scope&) = delete;
+};
+
+}
+
+class Profiler {
+  protected:
+	utils::AlignedArray<profiler::ThreadProfile> threads_;
+	int32_t nthreads_;
+	int32_t sample_;
+	double ticksPerSec_;
+	uint64_t origin_;
+
+	void calibrate();
+
+  public:
+	Profiler(int32_t, int32_t, size_t);
+
+	/**
+	* @Function: start a line of a thread, sampled lines set the current profile.
+	*/
+	inline void beginLine(int32_t threadId) {
+		profiler::ThreadProfile& p = threads_[threadId];
+		if (p.lines++ % sample_ == 0) {
+			p.sampledLines++;
+			profiler::current = &p;
+		} else {
+			profiler::current = nullptr;
+		}
+	}
+
+	inline void endLine() {
+		profiler::current = nullptr;
+	}
+
+	void report(const std::string&, std::ostream&) const;
+	void writeTrace(const std::string&) const;
+};
+
+/**
+* @Function: initial Profiler class argument.
+*/
+Profiler::Profiler(int32_t nthreads, int32_t sample, size_t maxEvents)
+	: threads_(utils::alignedArray<profiler::ThreadProfile>(nthreads)), nthreads_(nthreads), sample_(sample > 0 ? sample : 1) {
+	for (int32_t i = 0; i < nthreads_; i++) {
+		threads_[i].maxEvents = maxEvents;
+	}
+	calibrate();
+}
+
+/**
+* @Function: ticks per second of the counter.
+*/
+void Profiler::calibrate() {
+	auto t0 = std::chrono::steady_clock::now();
+	uint64_t c0 = profiler::ticks();
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	uint64_t c1 = profiler::ticks();
+	auto t1 = std::chrono::steady_clock::now();
+	double sec = std::chrono::duration<double>(t1 - t0).count();
+	ticksPerSec_ = sec > 0 ? (c1 - c0) / sec : 1e9;
+	origin_ = c1;
+}
+
+/**
+* @Function: per phase time of all threads, scaled up from the sampled lines.
+*/
+void Profiler::report(const std::string& mode, std::ostream& out) const {
+	double seconds[profiler::NPHASES] = { 0 };
+	uint64_t calls[profiler::NPHASES] = { 0 };
+	double total = 0.0;
+	int64_t lines = 0;
+	int64_t sampled = 0;
+	for (int32_t t = 0; t < nthreads_; t++) {
+		const profiler::ThreadProfile& p = threads_[t];
+		double scale = p.sampledLines > 0 ? double(p.lines) / p.sampledLines : 0.0;
+		for (int32_t i = 0; i < profiler::NPHASES; i++) {
+			seconds[i] += p.ticks[i] / ticksPerSec_ * scale;
+			calls[i] += p.calls[i];
+		}
+		lines += p.lines;
+		sampled += p.sampledLines;
+	}
+	for (int32_t i = 0; i < profiler::NPHASES; i++) {
+		total += seconds[i];
+	}
+	out << "Profile of [" << mode << "] model, " << sampled << " of " << lines
+		<< " lines sampled, seconds summed over threads" << std::endl;
+	out << std::fixed;
+	for (int32_t i = 0; i < profiler::NPHASES; i++) {
+		out << "  " << std::left << std::setw(18) << profiler::PHASE_NAMES[i] << std::right
+			<< std::setw(10) << std::setprecision(3) << seconds[i] << "s"
+			<< std::setw(7) << std::setprecision(1) << (total > 0 ? 100.0 * seconds[i] / total : 0.0) << "%"
+			<< std::setw(14) << calls[i] << " sampled calls" << std::endl;
+	}
+	out.unsetf(std::ios_base::floatfield);
+}
+
+/**
+* @Function: chrome trace-event file of the recorded events.
+*/
+void Profiler::writeTrace(const std::string& path) const {
+	std::ofstream ofs(path);
+	if (!ofs.is_open()) {
+		throw std::invalid_argument(path + " cannot be opened for saving the trace.");
+	}
+	double usPerTick = 1e6 / ticksPerSec_;
+	ofs << std::fixed << std::setprecision(3);
+	ofs << "{\"traceEvents\":[";
+	bool first = true;
+	for (int32_t t = 0; t < nthreads_; t++) {
+		const std::vector<profiler::Event>& events = threads_[t].events;
+		for (size_t i = 0; i < events.size(); i++) {
+			const profiler::Event& e = events[i];
+			ofs << (first ? "\n" : ",\n");
+			first = false;
+			ofs << "{\"name\":\"" << profiler::PHASE_NAMES[e.phase] << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << t
+				<< ",\"ts\":" << (int64_t(e.begin - origin_)) * usPerTick
+				<< ",\"dur\":" << (e.end - e.begin) * usPerTick << "}";
+		}
+	}
+	ofs << "\n]}" << std::endl;
+}
@@ -0,0 +1,599 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: quantizer.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: product quantization and per-row int8 compression of a binary model, searched on the codes.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "binmodel.h"
+#include "matrix.h"
+#include "neighbors.h"
+#include "kernels.h"
+#include "random.h"
+#include "real.h"
+#include "utils.h"
+
+/*
+* File layout, all offsets in bytes from the start of the file:
+*   Header                          64 bytes
+*   Section[3]                      words, features and targets
+* and for each section, each block 64-byte aligned:
+*   binmodel::Entry[n]              string offset, length and count
+*   string pool                     bytes of the strings, not terminated
+*   float[n]                        norm of each row, the codes hold the unit rows
+*   codebook                        pq: float[nsub][ksub][dsub], int8: float[n] scale of each row
+*   codes                           pq: uint8_t[n][nsub], int8: int8_t[n][dim]
+*/
+namespace quant {
+
+static const uint32_t MAGIC = 0x51563257; // "W2VQ" on little-endian
+static const uint32_t VERSION = 1;
+static const int32_t KSUB = 256;
+static const int32_t KMEANS_ITERATIONS = 25;
+static const int64_t KMEANS_SAMPLE = 65536;
+
+enum scheme : uint32_t { PQ = 1, INT8 = 2 };
+
+struct Header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t scheme;
+	uint32_t dim;
+	int32_t dsub;
+	int32_t nsub;
+	int32_t ksub;
+	int32_t reserved;
+	uint64_t size;
+	uint64_t pad[3];
+};
+static_assert(sizeof(Header) == 64, "quant::Header must stay 64 bytes");
+
+struct Section {
+	int64_t n;
+	uint64_t entries;
+	uint64_t strings;
+	uint64_t norms;
+	uint64_t codebook;
+	uint64_t codes;
+};
+static_assert(sizeof(Section) == 48, "quant::Section must stay 48 bytes");
+
+/**
+* @Function: rows of a section kept by frequency, the cutoff most frequent in id order, all if cutoff is 0.
+*/
+std::vector<int64_t> prune(const BinaryModel& model, int32_t s, size_t cutoff) {
+	const int64_t n = model.size(s);
+	std::vector<int64_t> keep(n);
+	for (int64_t i = 0; i < n; i++) {
+		keep[i] = i;
+	}
+	if (cutoff > 0 && size_t(n) > cutoff) {
+		std::stable_sort(keep.begin(), keep.end(), [&](int64_t a, int64_t b) {
+			return model.count(s, a) > model.count(s, b);
+		});
+		keep.resize(cutoff);
+		std::sort(keep.begin(), keep.end());
+	}
+	return keep;
+}
+
+/**
+* @Function: k-means of one subspace over the sample rows, centroids get ksub x dsub values.
+*/
+void kmeans(const Matrix& sample, int32_t offset, int32_t dsub, uint64_t seed, std::vector<float>& centroids) {
+	const int64_t n = sample.rows();
+	centroids.assign(KSUB * dsub, 0);
+	for (int32_t c = 0; c < KSUB; c++) {
+		const real* x = sample.row(c * n / KSUB) + offset;
+		for (int32_t d = 0; d < dsub; d++) {
+			centroids[c * dsub + d] = x[d];
+		}
+	}
+	std::vector<int32_t> assign(n);
+	std::vector<double> sums(KSUB * dsub);
+	std::vector<int64_t> sizes(KSUB);
+	for (int32_t it = 0; it < KMEANS_ITERATIONS; it++) {
+		std::fill(sums.begin(), sums.end(), 0.0);
+		std::fill(sizes.begin(), sizes.end(), 0);
+		for (int64_t i = 0; i < n; i++) {
+			const real* x = sample.row(i) + offset;
+			float best = INFINITY;
+			for (int32_t c = 0; c < KSUB; c++) {
+				float dist = 0;
+				for (int32_t d = 0; d < dsub; d++) {
+					float diff = x[d] - centroids[c * dsub + d];
+					dist += diff * diff;
+				}
+				if (dist < best) {
+					best = dist;
+					assign[i] = c;
+				}
+			}
+			sizes[assign[i]]++;
+			for (int32_t d = 0; d < dsub; d++) {
+				sums[assign[i] * dsub + d] += x[d];
+			}
+		}
+		for (int32_t c = 0; c < KSUB; c++) {
+			if (sizes[c] > 0) {
+				for (int32_t d = 0; d < dsub; d++) {
+					centroids[c * dsub + d] = sums[c * dsub + d] / sizes[c];
+				}
+			} else {
+				// an empty centroid restarts on a sample row drawn from the counter of (iteration, centroid)
+				uint32_t ctr[4] = { uint32_t(it), uint32_t(c), uint32_t(offset), 0x4B4D4E53u };
+				rng::philox(ctr, seed);
+				const real* x = sample.row(ctr[0] % n) + offset;
+				for (int32_t d = 0; d < dsub; d++) {
+					centroids[c * dsub + d] = x[d];
+				}
+			}
+		}
+	}
+}
+
+/**
+* @Function: nearest centroid of a subvector.
+*/
+inline uint8_t encode(const real* x, const float* centroids, int32_t dsub) {
+	float best = INFINITY;
+	int32_t code = 0;
+	for (int32_t c = 0; c < KSUB; c++) {
+		float dist = 0;
+		for (int32_t d = 0; d < dsub; d++) {
+			float diff = x[d] - centroids[c * dsub + d];
+			dist += diff * diff;
+		}
+		if (dist < best) {
+			best = dist;
+			code = c;
+		}
+	}
+	return uint8_t(code);
+}
+
+/**
+* @Function: compress the words, features and targets of a binary model into path, the rows are normalized
+* and their norms kept apart, cutoff keeps the most frequent rows of each section, returns the bytes written.
+*/
+uint64_t quantize(const std::string& path, const BinaryModel& model, uint32_t scheme, int32_t dsub,
+		size_t cutoff, int32_t threads, uint64_t seed) {
+	threads = std::max(threads, 1);
+	const int32_t dim = model.dim();
+	if (scheme == PQ && (dsub <= 0 || dim % dsub != 0)) {
+		throw std::invalid_argument("-dsub " + std::to_string(dsub) + " must divide the dim " + std::to_string(dim));
+	}
+	Header h;
+	std::memset(&h, 0, sizeof(h));
+	h.magic = MAGIC;
+	h.version = VERSION;
+	h.scheme = scheme;
+	h.dim = dim;
+	h.dsub = scheme == PQ ? dsub : 0;
+	h.nsub = scheme == PQ ? dim / dsub : 0;
+	h.ksub = scheme == PQ ? KSUB : 0;
+
+	const std::string tmp = path + ".tmp";
+	std::ofstream ofs(tmp, std::ios::binary);
+	if (!ofs.is_open()) {
+		throw std::invalid_argument(tmp + " cannot be opened for saving the quantized model.");
+	}
+	Section sections[binmodel::NSECTIONS];
+	std::memset(sections, 0, sizeof(sections));
+	ofs.write((char*)&h, sizeof(h));
+	ofs.write((char*)sections, sizeof(sections));
+	uint64_t offset = sizeof(h) + sizeof(sections);
+
+	for (int32_t s = 0; s < binmodel::NSECTIONS; s++) {
+		std::vector<int64_t> keep = prune(model, s, cutoff);
+		const int64_t n = keep.size();
+		Section& sec = sections[s];
+		sec.n = n;
+
+		binmodel::pad(ofs, offset);
+		sec.entries = offset;
+		std::vector<std::string> strings(n);
+		uint64_t pool = 0;
+		for (int64_t i = 0; i < n; i++) {
+			strings[i] = model.string(s, keep[i]);
+			binmodel::Entry e;
+			e.offset = pool;
+			e.length = strings[i].size();
+			e.reserved = 0;
+			e.count = model.count(s, keep[i]);
+			ofs.write((char*)&e, sizeof(e));
+			pool += e.length;
+		}
+		offset += n * sizeof(binmodel::Entry);
+		sec.strings = offset;
+		for (int64_t i = 0; i < n; i++) {
+			ofs.write(strings[i].data(), strings[i].size());
+		}
+		offset += pool;
+
+		Matrix unit(n, dim);
+		std::vector<float> norms(n);
+		utils::parallel(threads, [&](int32_t t) {
+			for (int64_t i = n * t / threads; i < n * (t + 1) / threads; i++) {
+				std::memcpy(unit.row(i), model.vector(s, keep[i]), dim * sizeof(real));
+				norms[i] = unit.l2NormRow(i);
+				if (norms[i] > 0) {
+					kernels::scale<0>(unit.row(i), real(1.0) / norms[i], dim);
+				}
+			}
+		});
+		binmodel::pad(ofs, offset);
+		sec.norms = offset;
+		ofs.write((char*)norms.data(), n * sizeof(float));
+		offset += n * sizeof(float);
+
+		binmodel::pad(ofs, offset);
+		sec.codebook = offset;
+		if (scheme == PQ) {
+			const int32_t nsub = h.nsub;
+			std::vector<std::vector<float>> centroids(nsub);
+			if (n > 0) {
+				const int64_t ns = std::min(n, KMEANS_SAMPLE);
+				Matrix sample(ns, dim);
+				for (int64_t i = 0; i < ns; i++) {
+					std::memcpy(sample.row(i), unit.row(i * n / ns), dim * sizeof(real));
+				}
+				utils::parallel(threads, [&](int32_t t) {
+					for (int32_t j = t; j < nsub; j += threads) {
+						kmeans(sample, j * dsub, dsub, seed, centroids[j]);
+					}
+				});
+			}
+			for (int32_t j = 0; j < nsub; j++) {
+				centroids[j].resize(KSUB * dsub, 0.0f);
+				ofs.write((char*)centroids[j].data(), KSUB * dsub * sizeof(float));
+			}
+			offset += int64_t(nsub) * KSUB * dsub * sizeof(float);
+			std::vector<uint8_t> codes(n * nsub);
+			utils::parallel(threads, [&](int32_t t) {
+				for (int64_t i = n * t / threads; i < n * (t + 1) / threads; i++) {
+					for (int32_t j = 0; j < nsub; j++) {
+						codes[i * nsub + j] = encode(unit.row(i) + j * dsub, centroids[j].data(), dsub);
+					}
+				}
+			});
+			binmodel::pad(ofs, offset);
+			sec.codes = offset;
+			ofs.write((char*)codes.data(), codes.size());
+			offset += codes.size();
+		} else {
+			std::vector<float> scales(n);
+			std::vector<int8_t> codes(n * dim);
+			utils::parallel(threads, [&](int32_t t) {
+				for (int64_t i = n * t / threads; i < n * (t + 1) / threads; i++) {
+					const real* x = unit.row(i);
+					real amax = 0;
+					for (int32_t d = 0; d < dim; d++) {
+						amax = std::max(amax, std::abs(x[d]));
+					}
+					scales[i] = amax > 0 ? amax / 127 : 1;
+					for (int32_t d = 0; d < dim; d++) {
+						codes[i * dim + d] = int8_t(std::lrint(x[d] / scales[i]));
+					}
+				}
+			});
+			ofs.write((char*)scales.data(), n * sizeof(float));
+			offset += n * sizeof(float);
+			binmodel::pad(ofs, offset);
+			sec.codes = offset;
+			ofs.write((char*)codes.data(), codes.size());
+			offset += codes.size();
+		}
+	}
+	h.size = offset;
+	ofs.seekp(0);
+	ofs.write((char*)&h, sizeof(h));
+	ofs.write((char*)sections, sizeof(sections));
+	ofs.close();
+	if (!ofs) {
+		throw std::invalid_argument(tmp + " could not be written.");
+	}
+	if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+		throw std::invalid_argument(tmp + " cannot be renamed to " + path);
+	}
+	return offset;
+}
+
+}
+
+/**
+* @Function: read-only view of a quantized model mapped into memory, vectors are decoded on demand
+* and the searches score the codes directly, pq through a table of query-centroid products.
+*/
+class QuantizedModel {
+  protected:
+	std::shared_ptr<char> mapped_;
+	const quant::Header* header_;
+	const quant::Section* sections_;
+	std::unordered_map<std::string, int64_t> ids_[binmodel::NSECTIONS];
+	int32_t section_;
+	int32_t threads_;
+
+	inline const char* at(uint64_t offset) const {
+		return mapped_.get() + offset;
+	}
+	void prepare(const real*, std::vector<real>&) const;
+	void scores(const std::vector<real>&, int64_t, int64_t, real*) const;
+
+  public:
+	QuantizedModel();
+	explicit QuantizedModel(const std::string&);
+
+	void open(const std::string&);
+	inline const quant::Header& header() const {
+		return *header_;
+	}
+	inline int32_t dim() const {
+		return header_->dim;
+	}
+	inline int64_t size(int32_t s) const {
+		return sections_[s].n;
+	}
+	inline void setSection(int32_t s) {
+		section_ = s;
+	}
+	inline void setThreads(int32_t threads) {
+		threads_ = std::max(threads, 1);
+	}
+	std::string string(int32_t, int64_t) const;
+	int64_t count(int32_t, int64_t) const;
+	int64_t find(int32_t, const std::string&) const;
+	void reconstruct(int32_t, int64_t, real*) const;
+	void search(const Matrix&, int32_t, const std::vector<std::vector<int64_t>>&,
+		std::vector<std::vector<neighbors::Neighbor>>&) const;
+	void nearest(const std::vector<std::string>&, int32_t, std::vector<std::vector<neighbors::Neighbor>>&) const;
+};
+
+QuantizedModel::QuantizedModel() : header_(nullptr), sections_(nullptr), section_(binmodel::WORDS), threads_(1) {}
+
+QuantizedModel::QuantizedModel(const std::string& path) : QuantizedModel() {
+	open(path);
+}
+
+/**
+* @Function: map the file, check its header and index the strings.
+*/
+void QuantizedModel::open(const std::string& path) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		throw std::invalid_argument(path + " cannot be opened for loading the quantized model.");
+	}
+	const size_t bytes = st.st_size;
+	const size_t head = sizeof(quant::Header) + binmodel::NSECTIONS * sizeof(quant::Section);
+	void* p = bytes < head ? MAP_FAILED : mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED) {
+		throw std::invalid_argument(path + " is not a quantized model.");
+	}
+	mapped_ = std::shared_ptr<char>((char*)p, [bytes](char* q) { munmap(q, bytes); });
+	header_ = (const quant::Header*)p;
+	sections_ = (const quant::Section*)(mapped_.get() + sizeof(quant::Header));
+	if (header_->magic != quant::MAGIC || header_->version != quant::VERSION) {
+		throw std::invalid_argument(path + " is not a quantized model.");
+	}
+	if (header_->size > bytes) {
+		throw std::invalid_argument(path + " is truncated.");
+	}
+	for (int32_t s = 0; s < binmodel::NSECTIONS; s++) {
+		ids_[s].clear();
+		ids_[s].reserve(size(s));
+		for (int64_t i = 0; i < size(s); i++) {
+			ids_[s].emplace(string(s, i), i);
+		}
+	}
+}
+
+std::string QuantizedModel::string(int32_t s, int64_t id) const {
+	const binmodel::Entry& e = ((const binmodel::Entry*)at(sections_[s].entries))[id];
+	return std::string(at(sections_[s].strings) + e.offset, e.length);
+}
+
+int64_t QuantizedModel::count(int32_t s, int64_t id) const {
+	return ((const binmodel::Entry*)at(sections_[s].entries))[id].count;
+}
+
+/**
+* @Function: id of a string in a section, -1 if absent or pruned.
+*/
+int64_t QuantizedModel::find(int32_t s, const std::string& str) const {
+	auto it = ids_[s].find(str);
+	return it == ids_[s].end() ? -1 : it->second;
+}
+
+/**
+* @Function: decode a row, scaled back by its norm.
+*/
+void QuantizedModel::reconstruct(int32_t s, int64_t id, real* out) const {
+	const quant::Section& sec = sections_[s];
+	const int32_t dim = header_->dim;
+	const float norm = ((const float*)at(sec.norms))[id];
+	if (header_->scheme == quant::PQ) {
+		const int32_t nsub = header_->nsub;
+		const int32_t dsub = header_->dsub;
+		const float* centroids = (const float*)at(sec.codebook);
+		const uint8_t* codes = (const uint8_t*)at(sec.codes) + id * nsub;
+		for (int32_t j = 0; j < nsub; j++) {
+			const float* c = centroids + (int64_t(j) * quant::KSUB + codes[j]) * dsub;
+			for (int32_t d = 0; d < dsub; d++) {
+				out[j * dsub + d] = norm * c[d];
+			}
+		}
+	} else {
+		const float scale = norm * ((const float*)at(sec.codebook))[id];
+		const int8_t* codes = (const int8_t*)at(sec.codes) + id * dim;
+		for (int32_t d = 0; d < dim; d++) {
+			out[d] = scale * codes[d];
+		}
+	}
+}
+
+/**
+* @Function: what the scores of a unit query need, for pq the table of its products with each centroid
+* (asymmetric distance: the query stays exact and meets each centroid once), for int8 the query itself.
+*/
+void QuantizedModel::prepare(const real* q, std::vector<real>& table) const {
+	if (header_->scheme != quant::PQ) {
+		table.assign(q, q + dim());
+		return;
+	}
+	const int32_t nsub = header_->nsub;
+	const int32_t dsub = header_->dsub;
+	const float* centroids = (const float*)at(sections_[section_].codebook);
+	table.resize(int64_t(nsub) * quant::KSUB);
+	for (int32_t j = 0; j < nsub; j++) {
+		for (int32_t c = 0; c < quant::KSUB; c++) {
+			const float* x = centroids + (int64_t(j) * quant::KSUB + c) * dsub;
+			real d = 0;
+			for (int32_t k = 0; k < dsub; k++) {
+				d += q[j * dsub + k] * x[k];
+			}
+			table[j * quant::KSUB + c] = d;
+		}
+	}
+}
+
+/**
+* @Function: products of a prepared query with the decoded unit rows [ib, ie) of the selected section.
+*/
+void QuantizedModel::scores(const std::vector<real>& table, int64_t ib, int64_t ie, real* out) const {
+	const quant::Section& sec = sections_[section_];
+	if (header_->scheme == quant::PQ) {
+		const int32_t nsub = header_->nsub;
+		const uint8_t* codes = (const uint8_t*)at(sec.codes);
+		const real* t = table.data();
+		int64_t i = ib;
+		// four rows per pass over the tables, four independent sums instead of one chain of lookups
+		for (; i + 4 <= ie; i += 4) {
+			const uint8_t* c0 = codes + i * nsub;
+			const uint8_t* c1 = c0 + nsub;
+			const uint8_t* c2 = c1 + nsub;
+			const uint8_t* c3 = c2 + nsub;
+			real d0 = 0, d1 = 0, d2 = 0, d3 = 0;
+			for (int32_t j = 0; j < nsub; j++) {
+				const real* tj = t + j * quant::KSUB;
+				d0 += tj[c0[j]];
+				d1 += tj[c1[j]];
+				d2 += tj[c2[j]];
+				d3 += tj[c3[j]];
+			}
+			out[i - ib] = d0;
+			out[i - ib + 1] = d1;
+			out[i - ib + 2] = d2;
+			out[i - ib + 3] = d3;
+		}
+		for (; i < ie; i++) {
+			const uint8_t* code = codes + i * nsub;
+			real d = 0;
+			for (int32_t j = 0; j < nsub; j++) {
+				d += t[j * quant::KSUB + code[j]];
+			}
+			out[i - ib] = d;
+		}
+	} else {
+		const int32_t dim = header_->dim;
+		const real* q = table.data();
+		const float* scales = (const float*)at(sec.codebook);
+		const int8_t* codes = (const int8_t*)at(sec.codes);
+		for (int64_t i = ib; i < ie; i++) {
+			const int8_t* code = codes + i * dim;
+			real d = 0;
+			for (int32_t k = 0; k < dim; k++) {
+				d += q[k] * real(code[k]);
+			}
+			out[i - ib] = scales[i] * d;
+		}
+	}
+}
+
+/**
+* @Function: the search of NearestNeighbors over the codes of the selected section, cosine of unit rows.
+*/
+void QuantizedModel::search(const Matrix& queries, int32_t k, const std::vector<std::vector<int64_t>>& exclude,
+		std::vector<std::vector<neighbors::Neighbor>>& results) const {
+	if (queries.cols() != dim()) {
+		throw std::invalid_argument("the queries do not have dim " + std::to_string(dim()));
+	}
+	Matrix unit(queries);
+	NearestNeighbors::normalize(unit, 1);
+	const int64_t n = size(section_);
+	const int64_t nq = unit.rows();
+	results.assign(nq, std::vector<neighbors::Neighbor>());
+	if (k <= 0) {
+		return;
+	}
+	const int32_t threads = int32_t(std::max<int64_t>(1, std::min<int64_t>(threads_, n / neighbors::ROW_BLOCK)));
+	std::vector<std::vector<std::vector<neighbors::Neighbor>>> heaps(threads,
+		std::vector<std::vector<neighbors::Neighbor>>(nq));
+	const std::vector<int64_t> none;
+	utils::parallel(threads, [&](int32_t t) {
+		std::vector<real> block(neighbors::ROW_BLOCK);
+		std::vector<real> table;
+		for (int64_t q = 0; q < nq; q++) {
+			std::vector<neighbors::Neighbor>& heap = heaps[t][q];
+			prepare(unit.row(q), table);
+			for (int64_t rb = n * t / threads; rb < n * (t + 1) / threads; rb += neighbors::ROW_BLOCK) {
+				const int64_t re = std::min(n * (t + 1) / threads, rb + neighbors::ROW_BLOCK);
+				scores(table, rb, re, block.data());
+				for (int64_t i = rb; i < re; i++) {
+					neighbors::Neighbor c = { block[i - rb], i };
+					neighbors::offer(heap, k, c, exclude.empty() ? none : exclude[q]);
+				}
+			}
+		}
+	});
+	neighbors::merge(heaps, nq, k, results);
+}
+
+/**
+* @Function: neighbours of known names of the selected section, the name itself is skipped.
+*/
+void QuantizedModel::nearest(const std::vector<std::string>& names, int32_t k,
+		std::vector<std::vector<neighbors::Neighbor>>& results) const {
+	std::vector<int64_t> known;
+	std::vector<int64_t> ids;
+	for (size_t i = 0; i < names.size(); i++) {
+		int64_t id = find(section_, names[i]);
+		if (id >= 0) {
+			known.push_back(i);
+			ids.push_back(id);
+		}
+	}
+	Matrix queries(known.size(), dim());
+	std::vector<std::vector<int64_t>> exclude(known.size());
+	for (size_t i = 0; i < known.size(); i++) {
+		reconstruct(section_, ids[i], queries.row(i));
+		exclude[i].push_back(ids[i]);
+	}
+	std::vector<std::vector<neighbors::Neighbor>> found;
+	search(queries, k, exclude, found);
+	results.assign(names.size(), std::vector<neighbors::Neighbor>());
+	for (size_t i = 0; i < known.size(); i++) {
+		results[known[i]].swap(found[i]);
+	}
+}
@@ -0,0 +1,205 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: random.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: random engines of the training threads.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "real.h"
+
+namespace rng {
+
+/**
+* @Function: splitmix64, used to expand a seed into engine state.
+*/
+inline uint64_t splitmix64(uint64_t& x) {
+	uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/**
+* @Function: xoshiro256** engine.
+*/
+class xoshiro256 {
+  protected:
+	uint64_t s_[4];
+
+	static inline uint64_t rotl(uint64_t x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+
+  public:
+	typedef uint64_t result_type;
+
+	explicit xoshiro256(uint64_t seed = 0) {
+		this->seed(seed);
+	}
+
+	void seed(uint64_t seed) {
+		for (int i = 0; i < 4; i++) {
+			s_[i] = splitmix64(seed);
+		}
+	}
+
+	static constexpr result_type min() {
+		return 0;
+	}
+
+	static constexpr result_type max() {
+		return UINT64_MAX;
+	}
+
+	inline result_type operator()() {
+		const uint64_t result = rotl(s_[1] * 5, 7) * 9;
+		const uint64_t t = s_[1] << 17;
+		s_[2] ^= s_[0];
+		s_[3] ^= s_[1];
+		s_[1] ^= s_[2];
+		s_[0] ^= s_[3];
+		s_[2] ^= t;
+		s_[3] = rotl(s_[3], 45);
+		return result;
+	}
+
+	inline uint32_t next32() {
+		return uint32_t((*this)() >> 32);
+	}
+};
+
+/**
+* @Function: pcg32 (XSH RR) engine.
+*/
+class pcg32 {
+  protected:
+	uint64_t state_;
+	uint64_t inc_;
+
+  public:
+	typedef uint32_t result_type;
+
+	explicit pcg32(uint64_t seed = 0) {
+		this->seed(seed);
+	}
+
+	void seed(uint64_t seed) {
+		state_ = splitmix64(seed);
+		inc_ = splitmix64(seed) | 1;
+	}
+
+	static constexpr result_type min() {
+		return 0;
+	}
+
+	static constexpr result_type max() {
+		return UINT32_MAX;
+	}
+
+	inline result_type operator()() {
+		uint64_t old = state_;
+		state_ = old * 6364136223846793005ULL + inc_;
+		uint32_t xorshifted = uint32_t(((old >> 18) ^ old) >> 27);
+		uint32_t rot = uint32_t(old >> 59);
+		return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+	}
+
+	inline uint32_t next32() {
+		return (*this)();
+	}
+};
+
+/**
+* @Function: philox4x32-10, counter-based, four draws depend only on the counter and the key.
+*/
+inline void philox(uint32_t c[4], uint64_t key) {
+	uint32_t k0 = uint32_t(key);
+	uint32_t k1 = uint32_t(key >> 32);
+	for (int i = 0; i < 10; i++) {
+		uint64_t p0 = uint64_t(0xD2511F53u) * c[0];
+		uint64_t p1 = uint64_t(0xCD9E8D57u) * c[2];
+		uint32_t x0 = uint32_t(p1 >> 32) ^ c[1] ^ k0;
+		uint32_t x2 = uint32_t(p0 >> 32) ^ c[3] ^ k1;
+		c[1] = uint32_t(p1);
+		c[3] = uint32_t(p0);
+		c[0] = x0;
+		c[2] = x2;
+		k0 += 0x9E3779B9u;
+		k1 += 0xBB67AE85u;
+	}
+}
+
+/**
+* @Function: the engine of the training threads, swap it here.
+*/
+#ifdef W2V_RNG_PCG
+typedef pcg32 engine;
+#else
+typedef xoshiro256 engine;
+#endif
+
+/**
+* @Function: uniform integer in [0, n), multiply-shift reduction.
+*/
+template <class Engine>
+inline uint32_t bounded(Engine& g, uint32_t n) {
+	return uint32_t((uint64_t(g.next32()) * n) >> 32);
+}
+
+/**
+* @Function: uniform real in [0, 1).
+*/
+template <class Engine>
+inline real uniform(Engine& g) {
+	return real(g.next32() >> 8) * (real(1.0) / real(1 << 24));
+}
+
+/**
+* @Function: fill out with raw 32 bits draws.
+*/
+template <class Engine>
+inline void fill(Engine& g, uint32_t* out, int64_t n) {
+	for (int64_t i = 0; i < n; i++) {
+		out[i] = g.next32();
+	}
+}
+
+/**
+* @Function: fill out with uniform integers in [lo, hi].
+*/
+template <class Engine>
+inline void fillRange(Engine& g, int32_t* out, int64_t n, int32_t lo, int32_t hi) {
+	const uint32_t span = uint32_t(hi - lo + 1);
+	for (int64_t i = 0; i < n; i++) {
+		out[i] = lo + int32_t(bounded(g, span));
+	}
+}
+
+/**
+* @Function: probability to a 32 bits threshold, draw <= threshold keeps.
+*/
+inline uint32_t threshold(double p) {
+	if (p >= 1.0) {
+		return UINT32_MAX;
+	}
+	if (p <= 0.0) {
+		return 0;
+	}
+	return uint32_t(p * 4294967296.0);
+}
+
+/**
+* @Function: seed of a thread, stable for a given base seed.
+*/
+inline uint64_t threadSeed(uint64_t seed, int32_t threadId) {
+	uint64_t x = seed ^ (uint64_t(threadId) * 0xD1B54A32D192ED03ULL);
+	return splitmix64(x);
+}
+
+}
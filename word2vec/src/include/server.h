@@ -0,0 +1,428 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: server.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: query server on a unix domain socket, one loaded model shared by every client of the host.
+*/
+
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "matrix.h"
+#include "neighbors.h"
+#include "hnsw.h"
+#include "wordvectors.h"
+#include "exporter.h"
+#include "real.h"
+
+/*
+* Protocol, one request per line and one response line per request, in order on each connection:
+*   VEC <word>        the trained vector of a word of the vocabulary
+*   OOV <word>        the vector of any word, unseen words composed from their features
+*   NN [k] <word>     the k nearest words of any word, the word itself excluded
+* Responses are "OK" followed by the values, or by name score pairs for NN, or "ERR <message>".
+*/
+namespace server {
+
+// requests answered together by a worker, the NN queries of a batch are one search
+static const size_t MAX_BATCH = 256;
+static const size_t MAX_LINE = 1 << 20;
+static const int32_t POLL_MS = 200;
+
+static volatile std::sig_atomic_t interrupted = 0;
+
+inline void onSignal(int) {
+	interrupted = 1;
+}
+
+struct Request {
+	int fd;
+	std::string line;
+};
+
+/**
+* @Function: write all of text, false if the client went away.
+*/
+inline bool sendAll(int fd, const std::string& text) {
+	size_t sent = 0;
+	while (sent < text.size()) {
+		ssize_t n = ::send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+		if (n <= 0) {
+			return false;
+		}
+		sent += n;
+	}
+	return true;
+}
+
+}
+
+/**
+* @Function: one thread polls the connections and queues complete request lines, a fixed pool of
+* workers takes the queued requests in batches, a connection has at most one request queued so its
+* responses keep the order of its requests.
+*/
+class Server {
+  protected:
+	struct Connection {
+		std::string buffer;
+		bool busy;
+		bool closed;
+	};
+
+	std::shared_ptr<WordVectors> vectors_;
+	std::shared_ptr<NearestNeighbors> nn_;
+	std::shared_ptr<Hnsw> index_;
+	int32_t threads_;
+	int32_t k_;
+	int32_t precision_;
+
+	int listen_;
+	int wake_[2];
+	std::unordered_map<int, Connection> connections_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::deque<server::Request> queue_;
+	// connections whose request was answered, handed back to the polling thread
+	std::vector<int> done_;
+	std::atomic<bool> stop_;
+
+	void poll();
+	void dispatch(int, Connection&);
+	void work();
+	void answer(std::vector<server::Request>&);
+	void finish(int);
+
+  public:
+	Server(std::shared_ptr<WordVectors>, std::shared_ptr<NearestNeighbors>, std::shared_ptr<Hnsw>,
+		int32_t, int32_t, int32_t);
+
+	void run(const std::string&);
+	void stop();
+};
+
+/**
+* @Function: serve vectors, and neighbours from nn or from index when it is set.
+*/
+Server::Server(std::shared_ptr<WordVectors> vectors, std::shared_ptr<NearestNeighbors> nn, std::shared_ptr<Hnsw> index,
+		int32_t threads, int32_t k, int32_t precision) : vectors_(vectors), nn_(nn), index_(index),
+	threads_(std::max(threads, 1)), k_(k), precision_(precision), listen_(-1), stop_(false) {
+	wake_[0] = wake_[1] = -1;
+}
+
+/**
+* @Function: bind path and serve until stop is called or the process gets SIGINT or SIGTERM.
+*/
+void Server::run(const std::string& path) {
+	struct sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		throw std::invalid_argument(path + " is too long for a unix socket path.");
+	}
+	std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	listen_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	::unlink(path.c_str());
+	if (listen_ < 0 || ::bind(listen_, (struct sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(listen_, 128) != 0) {
+		throw std::invalid_argument(path + " cannot be bound: " + std::strerror(errno));
+	}
+	if (::pipe(wake_) != 0) {
+		throw std::invalid_argument(std::string("cannot create the wake-up pipe: ") + std::strerror(errno));
+	}
+	std::signal(SIGINT, server::onSignal);
+	std::signal(SIGTERM, server::onSignal);
+
+	std::vector<std::thread> workers;
+	for (int32_t t = 0; t < threads_; t++) {
+		workers.push_back(std::thread([this]() { work(); }));
+	}
+	poll();
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	cv_.notify_all();
+	for (size_t t = 0; t < workers.size(); t++) {
+		workers[t].join();
+	}
+	for (auto& c : connections_) {
+		::close(c.first);
+	}
+	connections_.clear();
+	::close(listen_);
+	::close(wake_[0]);
+	::close(wake_[1]);
+	::unlink(path.c_str());
+}
+
+/**
+* @Function: make run return.
+*/
+void Server::stop() {
+	stop_ = true;
+	if (wake_[1] >= 0) {
+		char c = 0;
+		ssize_t n = ::write(wake_[1], &c, 1);
+		(void)n;
+	}
+}
+
+/**
+* @Function: queue the next complete line of an idle connection.
+*/
+void Server::dispatch(int fd, Connection& c) {
+	if (c.busy) {
+		return;
+	}
+	size_t eol = c.buffer.find('\n');
+	if (eol == std::string::npos) {
+		return;
+	}
+	server::Request r;
+	r.fd = fd;
+	r.line = c.buffer.substr(0, eol);
+	c.buffer.erase(0, eol + 1);
+	if (!r.line.empty() && r.line.back() == '\r') {
+		r.line.pop_back();
+	}
+	c.busy = true;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		queue_.push_back(r);
+	}
+	cv_.notify_one();
+}
+
+/**
+* @Function: the polling loop, accepts connections, reads the idle ones and takes back the answered ones.
+*/
+void Server::poll() {
+	std::vector<struct pollfd> fds;
+	std::vector<int> done;
+	char chunk[65536];
+	while (!stop_ && !server::interrupted) {
+		fds.clear();
+		fds.push_back({ listen_, POLLIN, 0 });
+		fds.push_back({ wake_[0], POLLIN, 0 });
+		for (auto& c : connections_) {
+			if (!c.second.busy && !c.second.closed) {
+				fds.push_back({ c.first, POLLIN, 0 });
+			}
+		}
+		if (::poll(fds.data(), fds.size(), server::POLL_MS) < 0 && errno != EINTR) {
+			throw std::invalid_argument(std::string("poll failed: ") + std::strerror(errno));
+		}
+		if (fds[1].revents & POLLIN) {
+			ssize_t n = ::read(wake_[0], chunk, sizeof(chunk));
+			(void)n;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			done.swap(done_);
+		}
+		for (int fd : done) {
+			Connection& c = connections_[fd];
+			c.busy = false;
+			dispatch(fd, c);
+			if (c.closed && !c.busy) {
+				::close(fd);
+				connections_.erase(fd);
+			}
+		}
+		done.clear();
+		for (size_t i = 2; i < fds.size(); i++) {
+			if (fds[i].revents == 0) {
+				continue;
+			}
+			const int fd = fds[i].fd;
+			Connection& c = connections_[fd];
+			ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+			if (n > 0 && c.buffer.size() + n <= server::MAX_LINE) {
+				c.buffer.append(chunk, n);
+			} else {
+				// the lines already received are still answered before the connection is closed
+				c.closed = true;
+				if (n > 0) {
+					c.buffer.clear();
+				}
+			}
+			dispatch(fd, c);
+			if (c.closed && !c.busy) {
+				::close(fd);
+				connections_.erase(fd);
+			}
+		}
+		if (fds[0].revents & POLLIN) {
+			int fd = ::accept(listen_, nullptr, nullptr);
+			if (fd >= 0) {
+				Connection c;
+				c.busy = false;
+				c.closed = false;
+				connections_[fd] = c;
+			}
+		}
+	}
+}
+
+/**
+* @Function: hand a connection back to the polling thread.
+*/
+void Server::finish(int fd) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		done_.push_back(fd);
+	}
+	char c = 0;
+	ssize_t n = ::write(wake_[1], &c, 1);
+	(void)n;
+}
+
+/**
+* @Function: a worker, takes every queued request up to a batch and answers them.
+*/
+void Server::work() {
+	std::vector<server::Request> batch;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			cv_.wait(lock, [&]() { return stop_ || !queue_.empty(); });
+			if (queue_.empty()) {
+				return;
+			}
+			while (!queue_.empty() && batch.size() < server::MAX_BATCH) {
+				batch.push_back(queue_.front());
+				queue_.pop_front();
+			}
+		}
+		try {
+			answer(batch);
+		} catch (const std::exception& e) {
+			// nothing of the batch was sent yet, a failed batch must not take the worker down
+			for (size_t i = 0; i < batch.size(); i++) {
+				server::sendAll(batch[i].fd, std::string("ERR ") + e.what() + "\n");
+			}
+		}
+		for (size_t i = 0; i < batch.size(); i++) {
+			finish(batch[i].fd);
+		}
+		batch.clear();
+	}
+}
+
+/**
+* @Function: answer a batch, vector requests one by one and all the NN requests with one search.
+*/
+void Server::answer(std::vector<server::Request>& batch) {
+	const int64_t dim = vectors_->dim();
+	std::vector<std::string> responses(batch.size());
+	std::vector<size_t> nnRequests;
+	std::vector<int32_t> nnK;
+	std::vector<std::string> nnWords;
+	std::vector<real> vec(dim);
+	for (size_t i = 0; i < batch.size(); i++) {
+		const std::string& line = batch[i].line;
+		size_t sp = line.find(' ');
+		const std::string command = line.substr(0, sp);
+		std::string word = sp == std::string::npos ? "" : line.substr(sp + 1);
+		std::string& out = responses[i];
+		if (command == "VEC" || command == "OOV") {
+			if (word.empty()) {
+				out = "ERR missing word";
+			} else if (command == "VEC" && !vectors_->known(word)) {
+				out = "ERR unknown word";
+			} else if (!vectors_->get(word, vec.data())) {
+				out = "ERR no known feature";
+			} else {
+				out = "OK";
+				for (int64_t j = 0; j < dim; j++) {
+					out += ' ';
+					exporter::append(out, vec[j], precision_);
+				}
+			}
+		} else if (command == "NN") {
+			int64_t k = k_;
+			size_t end = word.find(' ');
+			if (end != std::string::npos && end > 0 && word.find_first_not_of("0123456789") == end) {
+				errno = 0;
+				k = std::strtoll(word.c_str(), nullptr, 10);
+				word = word.substr(end + 1);
+				if (errno == ERANGE || k <= 0) {
+					out = "ERR bad k";
+					continue;
+				}
+			}
+			// a k over the number of vectors asks for all of them
+			k = std::min(k, nn_->size());
+			if (word.empty()) {
+				out = "ERR missing word";
+			} else {
+				nnRequests.push_back(i);
+				nnK.push_back(int32_t(k));
+				nnWords.push_back(word);
+			}
+		} else {
+			out = "ERR unknown command, expected VEC, OOV or NN";
+		}
+	}
+	if (!nnRequests.empty()) {
+		Matrix queries(nnRequests.size(), dim);
+		std::vector<char> found;
+		vectors_->get(nnWords, queries, found, 1);
+		std::vector<std::vector<int64_t>> exclude(nnRequests.size());
+		int32_t k = 0;
+		for (size_t i = 0; i < nnRequests.size(); i++) {
+			int64_t id = nn_->find(nnWords[i]);
+			if (id >= 0) {
+				exclude[i].push_back(id);
+			}
+			k = std::max(k, nnK[i]);
+		}
+		std::vector<std::vector<neighbors::Neighbor>> results;
+		if (index_) {
+			index_->search(queries, k, exclude, results);
+		} else {
+			nn_->search(queries, k, exclude, results);
+		}
+		for (size_t i = 0; i < nnRequests.size(); i++) {
+			std::string& out = responses[nnRequests[i]];
+			if (!found[i]) {
+				out = "ERR no known feature";
+				continue;
+			}
+			out = "OK";
+			for (int32_t j = 0; j < nnK[i] && j < int32_t(results[i].size()); j++) {
+				out += ' ';
+				out += nn_->name(results[i][j].id);
+				out += ' ';
+				exporter::append(out, results[i][j].score, precision_);
+			}
+		}
+	}
+	for (size_t i = 0; i < batch.size(); i++) {
+		responses[i] += '\n';
+		server::sendAll(batch[i].fd, responses[i]);
+	}
+}
@@ -0,0 +1,136 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: sparsegrad.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: per-thread sparse gradient accumulator of the input matrix.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "matrix.h"
+#include "kernels.h"
+#include "memreport.h"
+#include "real.h"
+
+/*
+  Gradients of input rows are summed by row id and each touched row is
+  written to the shared matrix once per flush.
+*/
+class SparseGrad {
+  protected:
+	int64_t dim_;
+	// open addressing, keys_[slot] is a row id or -1, index_[slot] its position in rows_
+	std::vector<int32_t> keys_;
+	std::vector<int32_t> index_;
+	std::vector<int32_t> rows_;
+	std::vector<real> values_;
+	uint32_t mask_;
+
+	static inline uint32_t hash(int32_t row) {
+		return uint32_t(row) * 2654435761u;
+	}
+
+	void grow();
+
+  public:
+	explicit SparseGrad(int64_t dim);
+
+	real* row(int32_t);
+	void flush(Matrix&);
+	void clear();
+
+	inline int32_t size() const {
+		return rows_.size();
+	}
+
+	int64_t memoryUsage() const;
+};
+
+/**
+* @Function: initial SparseGrad class argument.
+*/
+SparseGrad::SparseGrad(int64_t dim) : dim_(dim), keys_(1024, -1), index_(1024, 0), mask_(1023) {
+	values_.reserve(256 * dim);
+}
+
+/**
+* @Function: accumulator of a row, zero on first touch.
+*/
+real* SparseGrad::row(int32_t row) {
+	uint32_t slot = hash(row) & mask_;
+	while (keys_[slot] != -1) {
+		if (keys_[slot] == row) {
+			return values_.data() + int64_t(index_[slot]) * dim_;
+		}
+		slot = (slot + 1) & mask_;
+	}
+	if (2 * (rows_.size() + 1) > keys_.size()) {
+		grow();
+		return this->row(row);
+	}
+	keys_[slot] = row;
+	index_[slot] = rows_.size();
+	rows_.push_back(row);
+	values_.resize(rows_.size() * dim_, 0.0);
+	return values_.data() + int64_t(index_[slot]) * dim_;
+}
+
+/**
+* @Function: double the table.
+*/
+void SparseGrad::grow() {
+	std::vector<int32_t> keys(keys_.size() * 2, -1);
+	std::vector<int32_t> index(keys_.size() * 2, 0);
+	uint32_t mask = keys.size() - 1;
+	for (size_t i = 0; i < rows_.size(); i++) {
+		uint32_t slot = hash(rows_[i]) & mask;
+		while (keys[slot] != -1) {
+			slot = (slot + 1) & mask;
+		}
+		keys[slot] = rows_[i];
+		index[slot] = i;
+	}
+	keys_.swap(keys);
+	index_.swap(index);
+	mask_ = mask;
+}
+
+/**
+* @Function: add every accumulated row to the matrix once, then clear.
+*/
+void SparseGrad::flush(Matrix& wi) {
+	assert(wi.cols() == dim_);
+	for (size_t i = 0; i < rows_.size(); i++) {
+		kernels::add<0>(wi.row(rows_[i]), values_.data() + i * dim_, dim_);
+		wi.markDirty(rows_[i]);
+	}
+	clear();
+}
+
+/**
+* @Function: drop the accumulated rows.
+*/
+void SparseGrad::clear() {
+	for (size_t i = 0; i < rows_.size(); i++) {
+		uint32_t slot = hash(rows_[i]) & mask_;
+		while (keys_[slot] != rows_[i]) {
+			slot = (slot + 1) & mask_;
+		}
+		keys_[slot] = -1;
+	}
+	rows_.clear();
+	values_.clear();
+}
+
+/**
+* @Function: bytes held by the accumulator.
+*/
+int64_t SparseGrad::memoryUsage() const {
+	return memreport::bytes(keys_) + memreport::bytes(index_) + memreport::bytes(rows_)
+		+ memreport::bytes(values_);
+}
@@ -0,0 +1,296 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: telemetry.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: training telemetry, wall-clock throughput, loss, phases and RSS.
+*/
+
+#pragma once
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <utility>
+
+#include "args.h"
+#include "real.h"
+#include "utils.h"
+
+namespace telemetry {
+
+/**
+* @Function: resident set size in bytes, 0 if unknown.
+*/
+int64_t rss() {
+	std::ifstream ifs("/proc/self/statm");
+	int64_t pages = 0;
+	int64_t resident = 0;
+	if (!(ifs >> pages >> resident)) {
+		return 0;
+	}
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+/**
+* @Function: peak resident set size in bytes, 0 if unknown.
+*/
+int64_t peakRss() {
+	std::ifstream ifs("/proc/self/status");
+	std::string line;
+	while (std::getline(ifs, line)) {
+		if (line.compare(0, 6, "VmHWM:") == 0) {
+			return std::stoll(line.substr(6)) * 1024;
+		}
+	}
+	return 0;
+}
+
+/**
+* @Function: reset the peak resident set size to the current one, false if the kernel does not allow it.
+*/
+bool resetPeakRss() {
+	std::ofstream ofs("/proc/self/clear_refs");
+	if (!ofs.is_open()) {
+		return false;
+	}
+	ofs << "5";
+	ofs.close();
+	return bool(ofs);
+}
+
+/**
+* @Function: nanoseconds of a monotonic clock.
+*/
+inline int64_t now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+class Telemetry {
+  protected:
+	// one cache line per thread, written by its owner only
+	struct alignas(64) ThreadStats {
+		std::atomic<int64_t> tokens;
+		std::atomic<int64_t> ioNanos;
+		std::atomic<int64_t> computeNanos;
+		std::atomic<real> loss;
+	};
+
+	std::shared_ptr<Args> args_;
+	utils::AlignedArray<ThreadStats> threads_;
+	int32_t nthreads_;
+	int64_t start_;
+	int64_t lastWrite_;
+	std::vector<std::pair<std::string, double> > phases_;
+	std::ofstream json_;
+
+	void writeJson(real, real, int64_t);
+	void writePrometheus(real, real, int64_t);
+
+  public:
+	explicit Telemetry(std::shared_ptr<Args>);
+
+	void start(int32_t);
+	void phase(const std::string&, double);
+
+	inline void addTokens(int32_t threadId, int64_t n) {
+		threads_[threadId].tokens.fetch_add(n, std::memory_order_relaxed);
+	}
+	inline void addIO(int32_t threadId, int64_t nanos) {
+		threads_[threadId].ioNanos.fetch_add(nanos, std::memory_order_relaxed);
+	}
+	inline void addCompute(int32_t threadId, int64_t nanos) {
+		threads_[threadId].computeNanos.fetch_add(nanos, std::memory_order_relaxed);
+	}
+	inline void setLoss(int32_t threadId, real loss) {
+		threads_[threadId].loss.store(loss, std::memory_order_relaxed);
+	}
+
+	double elapsed() const;
+	int64_t tokens() const;
+	real loss() const;
+	bool due() const;
+	void write(real, real);
+};
+
+/**
+* @Function: initial Telemetry class argument.
+*/
+Telemetry::Telemetry(std::shared_ptr<Args> args) : args_(args), nthreads_(0) {
+	start_ = telemetry::now();
+	lastWrite_ = start_;
+	if (args_->telemetry != "") {
+		json_.open(args_->telemetry);
+		if (!json_.is_open()) {
+			throw std::invalid_argument(args_->telemetry + " cannot be opened for telemetry.");
+		}
+	}
+}
+
+/**
+* @Function: reset the per-thread counters, called when training starts.
+*/
+void Telemetry::start(int32_t nthreads) {
+	nthreads_ = nthreads;
+	threads_ = utils::alignedArray<ThreadStats>(nthreads);
+	for (int32_t i = 0; i < nthreads; i++) {
+		threads_[i].tokens = 0;
+		threads_[i].ioNanos = 0;
+		threads_[i].computeNanos = 0;
+		threads_[i].loss = -1;
+	}
+	start_ = telemetry::now();
+	lastWrite_ = start_;
+}
+
+/**
+* @Function: record the wall-clock seconds of a phase.
+*/
+void Telemetry::phase(const std::string& name, double seconds) {
+	phases_.push_back(std::make_pair(name, seconds));
+}
+
+/**
+* @Function: wall-clock seconds since start.
+*/
+double Telemetry::elapsed() const {
+	return double(telemetry::now() - start_) / 1e9;
+}
+
+/**
+* @Function: tokens of all threads.
+*/
+int64_t Telemetry::tokens() const {
+	int64_t n = 0;
+	for (int32_t i = 0; i < nthreads_; i++) {
+		n += threads_[i].tokens.load(std::memory_order_relaxed);
+	}
+	return n;
+}
+
+/**
+* @Function: loss averaged over the threads which reported one, -1 if none.
+*/
+real Telemetry::loss() const {
+	real sum = 0.0;
+	int32_t n = 0;
+	for (int32_t i = 0; i < nthreads_; i++) {
+		real l = threads_[i].loss.load(std::memory_order_relaxed);
+		if (l >= 0) {
+			sum += l;
+			n++;
+		}
+	}
+	return n > 0 ? sum / n : -1;
+}
+
+/**
+* @Function: whether the telemetry interval has passed since the last write.
+*/
+bool Telemetry::due() const {
+	return double(telemetry::now() - lastWrite_) / 1e9 >= args_->telemetryInterval;
+}
+
+/**
+* @Function: write a record to the json-lines and prometheus files.
+*/
+void Telemetry::write(real progress, real lr) {
+	lastWrite_ = telemetry::now();
+	if (progress > 1.0) {
+		progress = 1.0;
+		lr = 0.0;
+	}
+	int64_t rss = telemetry::rss();
+	if (json_.is_open()) {
+		writeJson(progress, lr, rss);
+	}
+	if (args_->prometheus != "") {
+		writePrometheus(progress, lr, rss);
+	}
+}
+
+/**
+* @Function: one json object per line.
+*/
+void Telemetry::writeJson(real progress, real lr, int64_t rss) {
+	double t = elapsed();
+	std::ostringstream os;
+	os << std::setprecision(6);
+	os << "{\"time\":" << t;
+	os << ",\"progress\":" << progress;
+	os << ",\"tokens\":" << tokens();
+	os << ",\"tokens_per_sec\":" << (t > 0 ? tokens() / t : 0.0);
+	os << ",\"lr\":" << lr;
+	os << ",\"loss\":" << loss();
+	os << ",\"rss_bytes\":" << rss;
+	os << ",\"peak_rss_bytes\":" << telemetry::peakRss();
+	os << ",\"threads\":[";
+	for (int32_t i = 0; i < nthreads_; i++) {
+		const ThreadStats& s = threads_[i];
+		os << (i > 0 ? "," : "");
+		os << "{\"tokens_per_sec\":" << (t > 0 ? s.tokens / t : 0.0);
+		os << ",\"loss\":" << s.loss;
+		os << ",\"io_sec\":" << s.ioNanos / 1e9;
+		os << ",\"compute_sec\":" << s.computeNanos / 1e9 << "}";
+	}
+	os << "],\"phases\":{";
+	for (size_t i = 0; i < phases_.size(); i++) {
+		os << (i > 0 ? "," : "") << "\"" << phases_[i].first << "\":" << phases_[i].second;
+	}
+	os << "}}";
+	json_ << os.str() << std::endl;
+}
+
+/**
+* @Function: prometheus text format, replaced atomically.
+*/
+void Telemetry::writePrometheus(real progress, real lr, int64_t rss) {
+	double t = elapsed();
+	std::string tmp = args_->prometheus + ".tmp";
+	std::ofstream ofs(tmp);
+	if (!ofs.is_open()) {
+		std::cerr << tmp << " cannot be opened for telemetry." << std::endl;
+		return;
+	}
+	ofs << std::setprecision(10);
+	ofs << "# TYPE word2vec_progress gauge\n";
+	ofs << "word2vec_progress " << progress << "\n";
+	ofs << "# TYPE word2vec_tokens_total counter\n";
+	ofs << "word2vec_tokens_total " << tokens() << "\n";
+	ofs << "# TYPE word2vec_tokens_per_second gauge\n";
+	ofs << "word2vec_tokens_per_second " << (t > 0 ? tokens() / t : 0.0) << "\n";
+	ofs << "# TYPE word2vec_thread_tokens_per_second gauge\n";
+	for (int32_t i = 0; i < nthreads_; i++) {
+		ofs << "word2vec_thread_tokens_per_second{thread=\"" << i << "\"} "
+			<< (t > 0 ? threads_[i].tokens / t : 0.0) << "\n";
+	}
+	ofs << "# TYPE word2vec_thread_seconds counter\n";
+	for (int32_t i = 0; i < nthreads_; i++) {
+		ofs << "word2vec_thread_seconds{thread=\"" << i << "\",phase=\"io\"} " << threads_[i].ioNanos / 1e9 << "\n";
+		ofs << "word2vec_thread_seconds{thread=\"" << i << "\",phase=\"compute\"} " << threads_[i].computeNanos / 1e9 << "\n";
+	}
+	ofs << "# TYPE word2vec_learning_rate gauge\n";
+	ofs << "word2vec_learning_rate " << lr << "\n";
+	ofs << "# TYPE word2vec_loss gauge\n";
+	ofs << "word2vec_loss " << loss() << "\n";
+	ofs << "# TYPE word2vec_rss_bytes gauge\n";
+	ofs << "word2vec_rss_bytes " << rss << "\n";
+	ofs << "# TYPE word2vec_phase_seconds gauge\n";
+	for (size_t i = 0; i < phases_.size(); i++) {
+		ofs << "word2vec_phase_seconds{phase=\"" << phases_[i].first << "\"} " << phases_[i].second << "\n";
+	}
+	ofs.close();
+	std::rename(tmp.c_str(), args_->prometheus.c_str());
+}
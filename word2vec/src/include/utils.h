@@ -9,7 +9,17 @@
 
 #pragma once
 
+#include <cstdlib>
+#include <new>
+#include <memory>
 #include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
 
 #if defined(__clang__) || defined(__GNUC__)
 # define FASTTEXT_DEPRECATED(msg) __attribute__((__deprecated__(msg)))
@@ -30,5 +40,75 @@ void seek(std::ifstream& ifs, int64_t pos) {
     ifs.clear();
     ifs.seekg(std::streampos(pos));
 }
+
+/**
+ * Runs fn(t) on threads 0..n-1, the first exception is rethrown on the caller
+ * with its own type, as with a single thread.
+ */
+template <class Fn>
+void parallel(int32_t n, Fn fn) {
+    if (n <= 1) {
+        fn(0);
+        return;
+    }
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::exception_ptr error;
+    for (int32_t t = 0; t < n; t++) {
+        threads.push_back(std::thread([&, t]() {
+            try {
+                fn(t);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }));
+    }
+    for (int32_t t = 0; t < n; t++) {
+        threads[t].join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
 }
 
+static const size_t CACHE_LINE = 64;
+
+/**
+ * Destroys and frees an array of alignedArray.
+ */
+template <class T>
+struct AlignedDelete {
+    size_t n;
+    void operator()(T* p) const {
+        for (size_t i = 0; i < n; i++) {
+            p[i].~T();
+        }
+        free(p);
+    }
+};
+
+template <class T>
+using AlignedArray = std::unique_ptr<T[], AlignedDelete<T> >;
+
+/**
+ * n default-constructed T starting on a cache line, new T[n] of C++11 does
+ * not honor an alignas larger than the alignment of malloc.
+ */
+template <class T>
+AlignedArray<T> alignedArray(size_t n) {
+    static_assert(alignof(T) <= CACHE_LINE, "alignedArray aligns to a cache line at most");
+    void* p = nullptr;
+    if (posix_memalign(&p, CACHE_LINE, std::max<size_t>(n, 1) * sizeof(T)) != 0) {
+        throw std::bad_alloc();
+    }
+    T* a = (T*)p;
+    for (size_t i = 0; i < n; i++) {
+        new (a + i) T();
+    }
+    AlignedDelete<T> deleter = { n };
+    return AlignedArray<T>(a, deleter);
+}
+}
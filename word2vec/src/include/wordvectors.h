@@ -0,0 +1,186 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: wordvectors.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: vectors of any word, known words from their rows and unseen ones composed from their features.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+
+#include "args.h"
+#include "dictionary.h"
+#include "matrix.h"
+#include "binmodel.h"
+#include "lrucache.h"
+#include "kernels.h"
+#include "real.h"
+#include "utils.h"
+
+namespace wordvectors {
+
+static const int32_t CACHE_SHARDS = 64;
+
+}
+
+/**
+* @Function: a word of the vocabulary gets its trained row, another word the average of the rows of its
+* features (ngrams for subword, feature ngrams for subradical and subcomponent), composed vectors are cached.
+*/
+class WordVectors {
+  protected:
+	// the rules of the features, computeSubwords / computerSubfeat and the feature map
+	std::shared_ptr<Dictionary> dict_;
+	std::function<const real*(const std::string&)> word_;
+	std::function<const real*(const std::string&)> feature_;
+	int64_t dim_;
+	// keep the rows alive
+	std::shared_ptr<const Matrix> input_;
+	std::shared_ptr<const BinaryModel> model_;
+	LruCache<std::string, std::vector<real>> cache_;
+
+	bool compose(const std::string&, real*) const;
+
+  public:
+	WordVectors(std::shared_ptr<Dictionary>, std::shared_ptr<const Matrix>, size_t);
+	WordVectors(std::shared_ptr<Dictionary>, std::shared_ptr<const BinaryModel>, size_t);
+
+	static std::shared_ptr<Dictionary> rules(const BinaryModel&, const std::string&);
+
+	inline int64_t dim() const {
+		return dim_;
+	}
+	inline bool known(const std::string& word) const {
+		return word_(word) != nullptr;
+	}
+	inline int64_t cacheHits() const {
+		return cache_.hits();
+	}
+	inline int64_t cacheMisses() const {
+		return cache_.misses();
+	}
+	bool get(const std::string&, real*);
+	void get(const std::vector<std::string>&, Matrix&, std::vector<char>&, int32_t);
+};
+
+/**
+* @Function: vectors of a trained model, the words and features of dict are the rows of input.
+*/
+WordVectors::WordVectors(std::shared_ptr<Dictionary> dict, std::shared_ptr<const Matrix> input, size_t cacheSize)
+	: dict_(dict), dim_(input->cols()), input_(input), cache_(cacheSize, wordvectors::CACHE_SHARDS) {
+	const Dictionary* d = dict.get();
+	const Matrix* m = input.get();
+	word_ = [d, m](const std::string& w) -> const real* {
+		int32_t id = d->getWordId(w);
+		return id >= 0 ? m->row(id) : nullptr;
+	};
+	feature_ = [d, m](const std::string& f) -> const real* {
+		int32_t id = d->getFeatureId(f);
+		return id >= 0 ? m->row(int64_t(d->nwords()) + id) : nullptr;
+	};
+}
+
+/**
+* @Function: vectors of a binary model, rules gives the features of a word, see WordVectors::rules.
+*/
+WordVectors::WordVectors(std::shared_ptr<Dictionary> rules, std::shared_ptr<const BinaryModel> model, size_t cacheSize)
+	: dict_(rules), dim_(model->dim()), model_(model), cache_(cacheSize, wordvectors::CACHE_SHARDS) {
+	const BinaryModel* b = model.get();
+	word_ = [b](const std::string& w) -> const real* {
+		int64_t id = b->find(binmodel::WORDS, w);
+		return id >= 0 ? b->vector(binmodel::WORDS, id) : nullptr;
+	};
+	feature_ = [b](const std::string& f) -> const real* {
+		int64_t id = b->find(binmodel::FEATURES, f);
+		return id >= 0 ? b->vector(binmodel::FEATURES, id) : nullptr;
+	};
+}
+
+/**
+* @Function: an empty dictionary with the model, minn and maxn of a binary model, and the feature map
+* of featureFile (the -inradical or -incomponent file of the training) for subradical and subcomponent.
+*/
+std::shared_ptr<Dictionary> WordVectors::rules(const BinaryModel& model, const std::string& featureFile) {
+	std::shared_ptr<Args> args = std::make_shared<Args>();
+	args->model = model_name(model.header().model);
+	args->minn = model.header().minn;
+	args->maxn = model.header().maxn;
+	args->verbose = 0;
+	std::shared_ptr<Dictionary> dict = std::make_shared<Dictionary>(args);
+	if (args->model == model_name::subradical || args->model == model_name::subcomponent) {
+		std::ifstream ifs(featureFile);
+		if (!ifs.is_open()) {
+			throw std::invalid_argument("unseen words of a " + args->modelToString(args->model)
+				+ " model need its feature file [-inradical / -incomponent]");
+		}
+		dict->readFeature(ifs);
+	}
+	return dict;
+}
+
+/**
+* @Function: average of the rows of the features of word, false and zeros when none is known.
+*/
+bool WordVectors::compose(const std::string& word, real* out) const {
+	std::vector<std::string> substrings;
+	dict_->getSubwords(word, substrings);
+	kernels::zero<0>(out, dim_);
+	int32_t n = 0;
+	for (size_t i = 0; i < substrings.size(); i++) {
+		const real* row = feature_(substrings[i]);
+		if (row != nullptr) {
+			kernels::add<0>(out, row, dim_);
+			n++;
+		}
+	}
+	if (n > 0) {
+		kernels::scale<0>(out, real(1.0) / n, dim_);
+	}
+	return n > 0;
+}
+
+/**
+* @Function: vector of any word into out, false if the word is unknown and none of its features is.
+*/
+bool WordVectors::get(const std::string& word, real* out) {
+	const real* row = word_(word);
+	if (row != nullptr) {
+		std::memcpy(out, row, dim_ * sizeof(real));
+		return true;
+	}
+	std::vector<real> cached;
+	if (cache_.get(word, cached)) {
+		std::memcpy(out, cached.data(), dim_ * sizeof(real));
+		return std::any_of(cached.begin(), cached.end(), [](real v) { return v != 0; });
+	}
+	bool found = compose(word, out);
+	cache_.put(word, std::vector<real>(out, out + dim_));
+	return found;
+}
+
+/**
+* @Function: vectors of a batch of words into the rows of out, split over the threads.
+*/
+void WordVectors::get(const std::vector<std::string>& words, Matrix& out, std::vector<char>& found, int32_t threads) {
+	const int64_t n = words.size();
+	if (out.rows() < n || out.cols() != dim_) {
+		throw std::invalid_argument("the output matrix does not fit the words.");
+	}
+	found.assign(n, 0);
+	threads = int32_t(std::max<int64_t>(1, std::min<int64_t>(threads, n)));
+	utils::parallel(threads, [&](int32_t t) {
+		for (int64_t i = n * t / threads; i < n * (t + 1) / threads; i++) {
+			found[i] = get(words[i], out.row(i)) ? 1 : 0;
+		}
+	});
+}
@@ -10,8 +10,15 @@
 #include<vector>
 #include<string>
 
+#include <poll.h>
+
 #include "args.h"
 #include "fasttext.h"
+#include "neighbors.h"
+#include "hnsw.h"
+#include "quantizer.h"
+#include "server.h"
+#include "evaluation.h"
 
 
 void printUsage() {
@@ -24,6 +31,14 @@ void printUsage() {
 		<< "  subchar_chinese   ------ train chinses character embedding by use subchar_chinese model\n"
 		<< "  subradical   ------ train chinses character embedding by use subradical model\n"
 		<< "  subcomponent   ------ train chinses character embedding by use subcomponent model\n"
+		<< "  resume   ------ continue the training saved in a checkpoint [-checkpoint]\n"
+		<< "  update   ------ train the model of a checkpoint [-previous] further on a new corpus\n"
+		<< "  nn   ------ nearest neighbours of the words read from stdin [-vectors]\n"
+		<< "  hnsw   ------ build the hnsw index of the vectors and report its recall [-vectors]\n"
+		<< "  quantize   ------ compress a binary model with product quantization or int8 [-vectors]\n"
+		<< "  print-vectors   ------ vectors of the words read from stdin, unseen words composed [-vectors]\n"
+		<< "  serve   ------ answer VEC, OOV and NN requests on a unix socket [-vectors -socket]\n"
+		<< "  eval   ------ word analogy accuracy and word similarity spearman of the vectors [-vectors -analogy -similarity]\n"
 		<< std::endl;
 }
  
@@ -37,8 +52,286 @@ void train(const std::vector<std::string> args) {
 	std::cout << "Train Embedding By Using [" + args[1] + "] model have Finished" << std::endl;
 }
 
+void resume(const std::vector<std::string> args) {
+	std::cout << "Resume Training" << std::endl;
+	FastText fasttext;
+	fasttext.resume(args);
+	fasttext.saveVectors();
+	std::cout << "Resume Training have Finished" << std::endl;
+}
+
+void update(const std::vector<std::string> args) {
+	std::cout << "Update Training" << std::endl;
+	FastText fasttext;
+	fasttext.update(args);
+	fasttext.saveVectors();
+	std::cout << "Update Training have Finished" << std::endl;
+}
+
+/**
+* @Function: true when more of stdin is waiting, in the stream buffer or on the descriptor.
+*/
+bool inputWaiting() {
+	if (std::cin.rdbuf()->in_avail() > 0) {
+		return true;
+	}
+	struct pollfd p = { 0, POLLIN, 0 };
+	return poll(&p, 1, 0) > 0 && (p.revents & POLLIN) != 0;
+}
+
+/**
+* @Function: the next lines of stdin, at least one and then the ones already waiting up to max, false at the end of the input.
+*/
+bool readBatch(std::vector<std::string>& lines, size_t max) {
+	lines.clear();
+	std::string line;
+	while (lines.size() < max && std::getline(std::cin, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		lines.push_back(line);
+		if (!inputWaiting()) {
+			break;
+		}
+	}
+	return !lines.empty();
+}
+
+void nn(const std::vector<std::string> args) {
+	Args a = Args();
+	a.parseArgs(args);
+	if (a.vectors == "") {
+		throw std::invalid_argument("nn needs the vectors to query [-vectors]");
+	}
+	uint32_t magic = 0;
+	std::ifstream probe(a.vectors, std::ios::binary);
+	probe.read((char*)&magic, sizeof(magic));
+	probe.close();
+	// a quantized model is searched on its codes, other vectors exactly or through an hnsw index
+	std::shared_ptr<QuantizedModel> quantized;
+	std::shared_ptr<NearestNeighbors> exact;
+	std::shared_ptr<Hnsw> index;
+	if (magic == quant::MAGIC) {
+		quantized = std::make_shared<QuantizedModel>(a.vectors);
+		quantized->setSection(neighbors::sectionOf(a.section));
+		quantized->setThreads(a.thread);
+		std::cerr << "Loaded " << quantized->size(neighbors::sectionOf(a.section)) << " quantized vectors of dim "
+			<< quantized->dim() << std::endl;
+	} else {
+		std::vector<std::string> names;
+		std::shared_ptr<Matrix> vectors = neighbors::load(a.vectors, a.section, names, a.thread);
+		exact = std::make_shared<NearestNeighbors>(vectors, names, a.thread);
+		std::cerr << "Loaded " << exact->size() << " vectors of dim " << exact->dim() << std::endl;
+		if (a.index != "") {
+			index = std::make_shared<Hnsw>(vectors);
+			index->load(a.index);
+			index->setEfSearch(a.efSearch);
+			index->setThreads(a.thread);
+		}
+	}
+	const int32_t section = neighbors::sectionOf(a.section);
+	// the queries read so far are answered together once no more input is waiting
+	std::vector<std::string> queries;
+	std::vector<std::vector<neighbors::Neighbor>> results;
+	while (readBatch(queries, 4096)) {
+		if (quantized) {
+			quantized->nearest(queries, a.k, results);
+		} else if (index) {
+			exact->nearest(*index, queries, a.k, results);
+		} else {
+			exact->nearest(queries, a.k, results);
+		}
+		for (size_t i = 0; i < queries.size(); i++) {
+			std::cout << queries[i];
+			if ((quantized ? quantized->find(section, queries[i]) : exact->find(queries[i])) < 0) {
+				std::cout << " not found";
+			}
+			for (size_t j = 0; j < results[i].size(); j++) {
+				const int64_t id = results[i][j].id;
+				std::cout << " " << (quantized ? quantized->string(section, id) : exact->name(id)) << " " << results[i][j].score;
+			}
+			std::cout << "\n";
+		}
+		std::cout.flush();
+	}
+}
+
+void index(const std::vector<std::string> args) {
+	Args a = Args();
+	a.parseArgs(args);
+	if (a.vectors == "") {
+		throw std::invalid_argument("hnsw needs the vectors to index [-vectors]");
+	}
+	const std::string path = a.index == "" ? a.vectors + ".hnsw" : a.index;
+	std::vector<std::string> names;
+	std::shared_ptr<Matrix> vectors = neighbors::load(a.vectors, a.section, names, a.thread);
+	NearestNeighbors nn(vectors, names, a.thread);
+	std::cerr << "Loaded " << nn.size() << " vectors of dim " << nn.dim() << std::endl;
+	Hnsw index(vectors);
+	int64_t start = telemetry::now();
+	index.build(a.M, a.efConstruction, a.thread, a.seed);
+	std::cerr << "Built the index in " << (telemetry::now() - start) / 1e9 << " s, "
+		<< index.memoryUsage() / (1 << 20) << " MB" << std::endl;
+	index.save(path);
+	std::cerr << "Saved " << path << std::endl;
+	index.setEfSearch(a.efSearch);
+	index.setThreads(a.thread);
+	start = telemetry::now();
+	double recall = index.recall(nn, a.k, 1000);
+	std::cerr << "Recall@" << a.k << " " << recall << " at efSearch " << a.efSearch << ", "
+		<< (telemetry::now() - start) / 1e6 << " ms for the queries and their exact search" << std::endl;
+}
+
+void quantize(const std::vector<std::string> args) {
+	Args a = Args();
+	a.parseArgs(args);
+	if (a.vectors == "") {
+		throw std::invalid_argument("quantize needs a binary model saved with -saveBinary [-vectors]");
+	}
+	if (a.quantizer != "pq" && a.quantizer != "int8") {
+		throw std::invalid_argument("unknown quantizer " + a.quantizer + ", expected pq or int8.");
+	}
+	const std::string path = a.output == "" ? a.vectors + ".q" : a.output;
+	BinaryModel model(a.vectors);
+	int64_t start = telemetry::now();
+	uint64_t bytes = quant::quantize(path, model, a.quantizer == "pq" ? quant::PQ : quant::INT8, a.dsub,
+		a.cutoff, a.thread, a.seed);
+	std::cerr << "Quantized " << a.vectors << " in " << (telemetry::now() - start) / 1e9 << " s, "
+		<< model.header().size << " -> " << bytes << " bytes, " << double(model.header().size) / bytes
+		<< "x smaller" << std::endl;
+
+	// quality of the codes: cosine of the decoded rows to the originals, recall@k of the search on the codes
+	QuantizedModel quantized(path);
+	quantized.setThreads(a.thread);
+	const int32_t dim = model.dim();
+	const char* names[] = { "words", "features", "targets" };
+	for (int32_t s = 0; s < binmodel::NSECTIONS; s++) {
+		const int64_t n = quantized.size(s);
+		if (n == 0) {
+			continue;
+		}
+		std::vector<std::string> strings(n);
+		std::shared_ptr<Matrix> vectors = std::make_shared<Matrix>(n, dim);
+		std::vector<real> decoded(dim);
+		double cosine = 0;
+		for (int64_t i = 0; i < n; i++) {
+			strings[i] = quantized.string(s, i);
+			const real* x = model.vector(s, model.find(s, strings[i]));
+			std::memcpy(vectors->row(i), x, dim * sizeof(real));
+			quantized.reconstruct(s, i, decoded.data());
+			real nx = vectors->l2NormRow(i);
+			real nd = std::sqrt(kernels::dot<0>(decoded.data(), decoded.data(), dim));
+			cosine += nx > 0 && nd > 0 ? kernels::dot<0>(x, decoded.data(), dim) / (nx * nd) : 1.0;
+		}
+		NearestNeighbors exact(vectors, strings, a.thread);
+		const int64_t sample = std::min<int64_t>(n, 200);
+		Matrix queries(sample, dim);
+		std::vector<std::vector<int64_t>> exclude(sample);
+		for (int64_t i = 0; i < sample; i++) {
+			std::memcpy(queries.row(i), vectors->row(i * n / sample), dim * sizeof(real));
+			exclude[i].push_back(i * n / sample);
+		}
+		std::vector<std::vector<neighbors::Neighbor>> truth;
+		std::vector<std::vector<neighbors::Neighbor>> found;
+		exact.search(queries, a.k, exclude, truth);
+		quantized.setSection(s);
+		quantized.search(queries, a.k, exclude, found);
+		int64_t hits = 0;
+		int64_t total = 0;
+		for (int64_t i = 0; i < sample; i++) {
+			total += truth[i].size();
+			for (const neighbors::Neighbor& t : truth[i]) {
+				for (const neighbors::Neighbor& f : found[i]) {
+					hits += f.id == t.id;
+				}
+			}
+		}
+		std::cerr << names[s] << ": " << n << " of " << model.size(s) << " rows, mean cosine to the original "
+			<< cosine / n << ", recall@" << a.k << " " << (total == 0 ? 1.0 : double(hits) / total) << std::endl;
+	}
+}
+
+void printVectors(const std::vector<std::string> args) {
+	Args a = Args();
+	a.parseArgs(args);
+	if (a.vectors == "") {
+		throw std::invalid_argument("print-vectors needs a binary model saved with -saveBinary [-vectors]");
+	}
+	std::shared_ptr<BinaryModel> model = std::make_shared<BinaryModel>(a.vectors);
+	const std::string featureFile = model_name(model->header().model) == model_name::subradical ? a.inradical : a.incomponent;
+	WordVectors vectors(WordVectors::rules(*model, featureFile), model, a.cacheSize);
+	std::vector<std::string> words;
+	std::vector<char> found;
+	std::string text;
+	while (readBatch(words, 4096)) {
+		Matrix out(words.size(), vectors.dim());
+		vectors.get(words, out, found, a.thread);
+		for (size_t i = 0; i < words.size(); i++) {
+			text = words[i];
+			for (int64_t j = 0; j < out.cols(); j++) {
+				text += ' ';
+				exporter::append(text, out.at(i, j), a.exportPrecision);
+			}
+			std::cout << text << "\n";
+		}
+		std::cout.flush();
+	}
+	if (a.verbose > 1) {
+		std::cerr << "cache hits " << vectors.cacheHits() << ", misses " << vectors.cacheMisses() << std::endl;
+	}
+}
+
+void serve(const std::vector<std::string> args) {
+	Args a = Args();
+	a.parseArgs(args);
+	if (a.vectors == "") {
+		throw std::invalid_argument("serve needs a binary model saved with -saveBinary [-vectors]");
+	}
+	std::shared_ptr<BinaryModel> model = std::make_shared<BinaryModel>(a.vectors);
+	const std::string featureFile = model_name(model->header().model) == model_name::subradical ? a.inradical : a.incomponent;
+	std::shared_ptr<WordVectors> vectors = std::make_shared<WordVectors>(WordVectors::rules(*model, featureFile),
+		model, a.cacheSize);
+	std::vector<std::string> names;
+	std::shared_ptr<Matrix> words = neighbors::load(a.vectors, "words", names, a.thread);
+	std::shared_ptr<NearestNeighbors> nn = std::make_shared<NearestNeighbors>(words, names, a.thread);
+	std::shared_ptr<Hnsw> index;
+	if (a.index != "") {
+		index = std::make_shared<Hnsw>(words);
+		index->load(a.index);
+		index->setEfSearch(a.efSearch);
+	}
+	Server server(vectors, nn, index, a.thread, a.k, a.exportPrecision);
+	std::cerr << "Serving " << nn->size() << " words of dim " << nn->dim() << " on " << a.socket << std::endl;
+	server.run(a.socket);
+	std::cerr << "Stopped" << std::endl;
+}
+
+void eval(const std::vector<std::string> args) {
+	Args a = Args();
+	a.parseArgs(args);
+	if (a.vectors == "") {
+		throw std::invalid_argument("eval needs the vectors to evaluate [-vectors]");
+	}
+	Evaluator evaluator(a.analogy, a.similarity);
+	if (evaluator.empty()) {
+		throw std::invalid_argument("eval needs an analogy or a similarity set [-analogy -similarity]");
+	}
+	int64_t start = telemetry::now();
+	std::vector<std::string> names;
+	std::shared_ptr<Matrix> vectors = neighbors::load(a.vectors, a.section, names, a.thread);
+	NearestNeighbors nn(vectors, names, a.thread);
+	std::cerr << "Loaded " << nn.size() << " vectors of dim " << nn.dim() << " in " << std::fixed
+		<< std::setprecision(2) << (telemetry::now() - start) / 1e9 << "s" << std::endl;
+	start = telemetry::now();
+	evaluation::Report report = evaluator.evaluate(nn, a.thread);
+	Evaluator::print(report, std::cout);
+	std::cerr << "Evaluated in " << std::fixed << std::setprecision(2) << (telemetry::now() - start) / 1e9 << "s" << std::endl;
+}
+
 int main(int argc, char** argv){
 	//std::cout << "word2vec" << std::endl;
+	// std::cin keeps its own buffer, so in_avail sees the lines read ahead of the current one
+	std::ios::sync_with_stdio(false);
 	std::vector<std::string> args(argv, argv + argc);
 	if (args.size() < 2) {
 		printUsage();
@@ -48,14 +341,41 @@ int main(int argc, char** argv){
 	std::string command(args[1]);
 	//std::cout << command << std::endl;
 	if (command != "skipgram" && command != "cbow" && command != "subword" && command != "subchar_chinese"
-		&& command != "subradical" && command != "subcomponent") {
+		&& command != "subradical" && command != "subcomponent" && command != "resume" && command != "update"
+		&& command != "nn" && command != "hnsw"
+		&& command != "quantize" && command != "print-vectors"
+		&& command != "serve" && command != "eval") {
 		std::cerr << "\nError command: " + command << std::endl;
 		printUsage();
 		std::getchar();
 		exit(EXIT_FAILURE);
 	}
 	// train start
-	train(args);
+	if (command == "resume") {
+		resume(args);
+	} else if (command == "update") {
+		update(args);
+	} else if (command == "nn") {
+		nn(args);
+		return 0;
+	} else if (command == "hnsw") {
+		index(args);
+		return 0;
+	} else if (command == "quantize") {
+		quantize(args);
+		return 0;
+	} else if (command == "print-vectors") {
+		printVectors(args);
+		return 0;
+	} else if (command == "serve") {
+		serve(args);
+		return 0;
+	} else if (command == "eval") {
+		eval(args);
+		return 0;
+	} else {
+		train(args);
+	}
 	std::getchar();
 	return 0;
 }
\ No newline at end of file
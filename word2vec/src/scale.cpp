@@ -0,0 +1,341 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: scale.cpp
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: end-to-end throughput and thread-scaling benchmark on synthetic Zipfian corpora.
+*/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "random.h"
+
+struct Config {
+	std::string dir = "/tmp/word2vec_scale";
+	std::string bin = "";
+	int64_t vocab = 100000;
+	double zipf = 1.0;
+	int64_t tokens = 10000000;
+	int32_t sentence = 20;
+	std::string charset = "cjk";
+	std::vector<std::string> models = { "skipgram", "cbow", "subword", "subradical", "subcomponent" };
+	std::vector<int32_t> threads = { 1, 2, 4, 8 };
+	std::vector<int32_t> dims = { 100 };
+	int32_t epoch = 1;
+	int32_t minCount = 5;
+	bool generateOnly = false;
+	uint64_t seed = 1;
+};
+
+/**
+* @Function: append a code point as utf-8.
+*/
+void utf8(uint32_t cp, std::string& out) {
+	if (cp < 0x80) {
+		out.push_back(char(cp));
+	} else if (cp < 0x800) {
+		out.push_back(char(0xC0 | (cp >> 6)));
+		out.push_back(char(0x80 | (cp & 0x3F)));
+	} else {
+		out.push_back(char(0xE0 | (cp >> 12)));
+		out.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+		out.push_back(char(0x80 | (cp & 0x3F)));
+	}
+}
+
+/**
+* @Function: the i-th word, cjk characters or latin letters.
+*/
+std::string makeWord(int64_t i, const std::string& charset) {
+	std::string word;
+	if (charset == "cjk") {
+		// CJK unified ideographs U+4E00..U+9FA5, one character per word while they last
+		const int64_t n = 0x9FA5 - 0x4E00 + 1;
+		do {
+			utf8(uint32_t(0x4E00 + i % n), word);
+			i /= n;
+		} while (i > 0);
+	} else {
+		do {
+			word.push_back(char('a' + i % 26));
+			i /= 26;
+		} while (i > 0);
+		while (word.size() < 3) {
+			word.push_back('a');
+		}
+	}
+	return word;
+}
+
+/**
+* @Function: corpus, radical and component files of the config.
+*/
+void generate(const Config& c, const std::string& corpus, const std::string& radical, const std::string& component) {
+	std::cerr << "generating " << c.tokens << " tokens, vocab " << c.vocab << ", zipf " << c.zipf << std::endl;
+	std::vector<std::string> words(c.vocab);
+	for (int64_t i = 0; i < c.vocab; i++) {
+		words[i] = makeWord(i, c.charset);
+	}
+	std::vector<double> cdf(c.vocab);
+	double z = 0.0;
+	for (int64_t i = 0; i < c.vocab; i++) {
+		z += 1.0 / std::pow(double(i + 1), c.zipf);
+		cdf[i] = z;
+	}
+	rng::engine g(c.seed);
+	std::ofstream ofs(corpus);
+	std::string line;
+	int64_t written = 0;
+	while (written < c.tokens) {
+		int32_t length = 1 + int32_t(rng::bounded(g, 2 * c.sentence - 1));
+		line.clear();
+		for (int32_t j = 0; j < length && written < c.tokens; j++, written++) {
+			double u = (double(g() >> 11) / 9007199254740992.0) * z;
+			int64_t id = std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+			line += words[std::min(id, c.vocab - 1)];
+			line.push_back(' ');
+		}
+		line.push_back('\n');
+		ofs << line;
+	}
+	ofs.close();
+
+	// radicals and components drawn from the Kangxi radicals block U+2F00..U+2FD5
+	std::ofstream rfs(radical);
+	std::ofstream cfs(component);
+	for (int64_t i = 0; i < c.vocab; i++) {
+		std::string r;
+		utf8(0x2F00 + rng::bounded(g, 214), r);
+		rfs << words[i] << " " << r << "\n";
+		int32_t ncomp = 2 + rng::bounded(g, 5);
+		cfs << words[i];
+		for (int32_t j = 0; j < ncomp; j++) {
+			std::string comp;
+			utf8(0x2F00 + rng::bounded(g, 214), comp);
+			cfs << " " << comp;
+		}
+		cfs << "\n";
+	}
+}
+
+/**
+* @Function: numeric field of the last json line of a file, -1 if missing.
+*/
+double jsonField(const std::string& path, const std::string& key) {
+	std::ifstream ifs(path);
+	std::string line;
+	std::string last;
+	while (std::getline(ifs, line)) {
+		if (!line.empty()) {
+			last = line;
+		}
+	}
+	size_t pos = last.find("\"" + key + "\":");
+	if (pos == std::string::npos) {
+		return -1;
+	}
+	return std::strtod(last.c_str() + pos + key.size() + 3, nullptr);
+}
+
+struct Result {
+	double wall;
+	double trainSec;
+	double tokens;
+	int64_t peakRss;
+	int status;
+};
+
+/**
+* @Function: run one training job, its output goes to log.
+*/
+Result runJob(const std::vector<std::string>& argv, const std::string& log) {
+	Result r = { 0, 0, 0, 0, -1 };
+	auto start = std::chrono::steady_clock::now();
+	pid_t pid = fork();
+	if (pid == 0) {
+		int in = open("/dev/null", O_RDONLY);
+		int out = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		dup2(in, 0);
+		dup2(out, 1);
+		dup2(out, 2);
+		std::vector<char*> args;
+		for (size_t i = 0; i < argv.size(); i++) {
+			args.push_back(const_cast<char*>(argv[i].c_str()));
+		}
+		args.push_back(nullptr);
+		execv(args[0], args.data());
+		_exit(127);
+	}
+	int status = 0;
+	struct rusage usage;
+	wait4(pid, &status, 0, &usage);
+	r.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	r.status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+	r.peakRss = int64_t(usage.ru_maxrss) * 1024;
+	return r;
+}
+
+std::vector<std::string> split(const std::string& s) {
+	std::vector<std::string> out;
+	std::stringstream ss(s);
+	std::string item;
+	while (std::getline(ss, item, ',')) {
+		if (!item.empty()) {
+			out.push_back(item);
+		}
+	}
+	return out;
+}
+
+std::vector<int32_t> splitInt(const std::string& s) {
+	std::vector<int32_t> out;
+	std::vector<std::string> items = split(s);
+	for (size_t i = 0; i < items.size(); i++) {
+		out.push_back(std::stoi(items[i]));
+	}
+	return out;
+}
+
+void printUsage(const Config& c) {
+	std::cerr
+		<< "usage: word2vec_scale <args>\n\n"
+		<< "  -dir           working directory default:[" << c.dir << "]\n"
+		<< "  -bin           word2vec executable default:[next to word2vec_scale]\n"
+		<< "  -vocab         vocabulary size default:[" << c.vocab << "]\n"
+		<< "  -zipf          zipf exponent default:[" << c.zipf << "]\n"
+		<< "  -tokens        corpus tokens default:[" << c.tokens << "]\n"
+		<< "  -sentence      mean sentence length default:[" << c.sentence << "]\n"
+		<< "  -charset       cjk or latin default:[" << c.charset << "]\n"
+		<< "  -models        comma separated models default:[skipgram,cbow,subword,subradical,subcomponent]\n"
+		<< "  -threads       comma separated thread counts default:[1,2,4,8]\n"
+		<< "  -dims          comma separated dims default:[100]\n"
+		<< "  -epoch         epochs of each run default:[" << c.epoch << "]\n"
+		<< "  -minCount      minimal word count default:[" << c.minCount << "]\n"
+		<< "  -seed          corpus seed default:[" << c.seed << "]\n"
+		<< "  -generateOnly  only write the corpora\n"
+		<< std::endl;
+}
+
+int main(int argc, char** argv) {
+	Config c;
+	std::vector<std::string> args(argv, argv + argc);
+	for (size_t ai = 1; ai < args.size(); ai += 2) {
+		if (args[ai] == "-generateOnly") {
+			c.generateOnly = true;
+			ai--;
+			continue;
+		}
+		if (ai + 1 >= args.size()) {
+			printUsage(c);
+			exit(EXIT_FAILURE);
+		}
+		const std::string& v = args[ai + 1];
+		if (args[ai] == "-dir") {
+			c.dir = v;
+		} else if (args[ai] == "-bin") {
+			c.bin = v;
+		} else if (args[ai] == "-vocab") {
+			c.vocab = std::stoll(v);
+		} else if (args[ai] == "-zipf") {
+			c.zipf = std::stod(v);
+		} else if (args[ai] == "-tokens") {
+			c.tokens = std::stoll(v);
+		} else if (args[ai] == "-sentence") {
+			c.sentence = std::stoi(v);
+		} else if (args[ai] == "-charset") {
+			c.charset = v;
+		} else if (args[ai] == "-models") {
+			c.models = split(v);
+		} else if (args[ai] == "-threads") {
+			c.threads = splitInt(v);
+		} else if (args[ai] == "-dims") {
+			c.dims = splitInt(v);
+		} else if (args[ai] == "-epoch") {
+			c.epoch = std::stoi(v);
+		} else if (args[ai] == "-minCount") {
+			c.minCount = std::stoi(v);
+		} else if (args[ai] == "-seed") {
+			c.seed = std::stoull(v);
+		} else {
+			printUsage(c);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (c.bin == "") {
+		std::string self = args[0];
+		size_t slash = self.find_last_of('/');
+		c.bin = (slash == std::string::npos ? std::string(".") : self.substr(0, slash)) + "/word2vec";
+	}
+	mkdir(c.dir.c_str(), 0755);
+	const std::string corpus = c.dir + "/corpus.txt";
+	const std::string radical = c.dir + "/radical.txt";
+	const std::string component = c.dir + "/component.txt";
+	generate(c, corpus, radical, component);
+	if (c.generateOnly) {
+		return 0;
+	}
+
+	std::cout << std::fixed;
+	std::cerr << std::fixed;
+	std::cerr << std::left << std::setw(14) << "model" << std::right << std::setw(6) << "dim" << std::setw(8) << "thread"
+		<< std::setw(14) << "tokens/sec" << std::setw(12) << "efficiency" << std::setw(12) << "peak MB"
+		<< std::setw(10) << "wall s" << std::endl;
+	for (size_t m = 0; m < c.models.size(); m++) {
+		for (size_t d = 0; d < c.dims.size(); d++) {
+			double base = 0.0;
+			for (size_t t = 0; t < c.threads.size(); t++) {
+				const std::string& model = c.models[m];
+				std::string tag = model + "." + std::to_string(c.dims[d]) + "d." + std::to_string(c.threads[t]) + "t";
+				std::string telemetry = c.dir + "/" + tag + ".jsonl";
+				std::vector<std::string> job = { c.bin, model, "-input", corpus, "-output", c.dir + "/" + tag,
+					"-dim", std::to_string(c.dims[d]), "-thread", std::to_string(c.threads[t]),
+					"-epoch", std::to_string(c.epoch), "-minCount", std::to_string(c.minCount),
+					"-verbose", "1", "-telemetry", telemetry, "-telemetryInterval", "1000000" };
+				if (model == "subradical") {
+					job.push_back("-inradical");
+					job.push_back(radical);
+				} else if (model == "subcomponent") {
+					job.push_back("-incomponent");
+					job.push_back(component);
+				}
+				Result r = runJob(job, c.dir + "/" + tag + ".log");
+				r.tokens = jsonField(telemetry, "tokens");
+				r.trainSec = jsonField(telemetry, "train");
+				double tps = (r.tokens > 0 && r.trainSec > 0) ? r.tokens / r.trainSec : 0.0;
+				if (t == 0) {
+					base = tps / c.threads[t];
+				}
+				double efficiency = base > 0 ? tps / (base * c.threads[t]) : 0.0;
+				std::cerr << std::left << std::setw(14) << model << std::right << std::setw(6) << c.dims[d]
+					<< std::setw(8) << c.threads[t] << std::setw(14) << int64_t(tps)
+					<< std::setw(12) << std::setprecision(2) << efficiency
+					<< std::setw(12) << std::setprecision(1) << r.peakRss / 1048576.0
+					<< std::setw(10) << std::setprecision(2) << r.wall
+					<< (r.status != 0 ? "  failed, see " + tag + ".log" : "") << std::endl;
+				std::cout << std::setprecision(4)
+					<< "{\"model\":\"" << model << "\",\"dim\":" << c.dims[d] << ",\"thread\":" << c.threads[t]
+					<< ",\"tokens_per_sec\":" << tps << ",\"scaling_efficiency\":" << efficiency
+					<< ",\"peak_rss_bytes\":" << r.peakRss << ",\"wall_sec\":" << r.wall
+					<< ",\"train_sec\":" << r.trainSec << ",\"status\":" << r.status << "}" << std::endl;
+			}
+		}
+	}
+	return 0;
+}